@@ -5,6 +5,13 @@
 #include "core/RIVlexicon.h"
 #include "core/RIVaccessories.h"
 #include "core/RIVmath.h"
+#include "core/RIVlexMerge.h"
+#include "core/RIVinput.h"
+#include "core/RIVcollection.h"
+#include "core/RIVvectorize.h"
+#include "core/RIVband.h"
+#include "core/RIVdedup.h"
+#include "core/RIVjoin.h"
 
 
 
@@ -14,9 +21,18 @@
  */
 sparseRIV* fileToL2(FILE *input);
 
+/* like fileToL2, but reads from the input layer (see RIVinput.h) */
+sparseRIV* inputToL2(RIVinput* input);
+
 /* like fileToL2 but takes a block of text */
 sparseRIV* textToL2(char *text);
 
+/* the same, for text given as a span, which need not be null terminated */
+sparseRIV* spanToL2(const char* text, size_t length);
+
+/* like textToL2 but takes a list of words, as produced by cleanToWords */
+sparseRIV* wordsToL2(char** words, int wordCount);
+
 /*cosine determines the "similarity" between two RIVs. */
 /*NOTE this legacy cosCompare is kept for simplicity, but the cos
  * defined in RIVmath.h RIVcosCompare(vectorA, vectorB) 
@@ -35,6 +51,19 @@ sparseRIV* normalize(denseRIV input, int factor);
  */
 sparseRIV* trueNormalize(denseRIV* input, double magnitude);
 
+/* normalize and trueNormalize, for a vector which is already sparse, as
+ * from lexPullSparse or a collection.  the result is a new sparse vector,
+ * and the input is left as it was, so that analysis need never make a
+ * denseRIV. both are reentrant
+ */
+sparseRIV* normalizeSparse(sparseRIV* input, int factor);
+sparseRIV* trueNormalizeSparse(sparseRIV* input, double magnitude);
+
+/* the body of both: a new sparse vector of the input's values, each scaled
+ * by "multiplier" and rounded, less those which round to 0.  "single" is
+ * as for scaleValues */
+sparseRIV* scaleSparse(sparseRIV* input, double multiplier, int single);
+
 /* replaceable with the above macro, this calculates sine distance
  * not true sine, a periodically useful metric of angle
  */
@@ -42,31 +71,28 @@ double sine(denseRIV* baseDense, sparseRIV* comparator);
 
 /* this converts a string of raw text into a vector format, based on 
  * the lexicon vectors of the words that form it.  this both stems and 
- * vectorizes the text based on the lexicon and stemroot it is given
+ * vectorizes the text based on the lexicon and stemroot it is given.
+ * to vectorize many documents, see vectorizeStream in RIVvectorize.h
  */
 sparseRIV* line2L3(LEXICON* lexicon, char* text, RIVtree* stemRoot);
 
 
 sparseRIV* textToBOWL2(char *text, RIVtree* root){
 	int wordCount = 0;
-	char word[100] = {0};
+	char word[TOKENSIZE] = {0};
 
 	int denseTemp[RIVSIZE] = {0};
 	/* locations (implicit RIV) are temp stored in temp block, and moved 
 	 * to permanent home in consolidation */
 	
-	int displacement = 0;
-	char* textEnd = text+strlen(text)-1;
+	const char* token;
+	size_t length;
+	RIVtokenizer tokens;
+	tokenizerInit(&tokens, text, strlen(text));
 
-	while(text<textEnd){
-		sscanf(text, "%99s%n", word, &displacement);
-		text += displacement+1;
-		if(!displacement){
-			break;
-		}
-		if(!(*word)){
-			break;
-		}
+	while((length = nextToken(&tokens, &token))){
+		/* the index tree needs the word as a string of its own */
+		copyToken(token, length, word);
 		
 		/* add word's L1 RIV to the accumulating denseRIV */
 		denseTemp[getBOWIndex(word, root)] += 1;
@@ -84,28 +110,25 @@ sparseRIV* textToBOWL2(char *text, RIVtree* root){
 
 
 sparseRIV* textToL2(char *text){
+	return spanToL2(text, strlen(text));
+}
+
+sparseRIV* spanToL2(const char* text, size_t length){
 	int wordCount = 0;
-	char word[100] = {0};
 
 	int denseTemp[RIVSIZE] = {0};
 	/* locations (implicit RIV) are temp stored in temp block, and moved 
 	 * to permanent home in consolidation */
 	
-	int displacement = 0;
-	char* textEnd = text+strlen(text)-1;
+	const char* token;
+	size_t tokenLength;
+	RIVtokenizer tokens;
+	tokenizerInit(&tokens, text, length);
 
-	while(text<textEnd){
-		sscanf(text, "%99s%n", word, &displacement);
-		text += displacement+1;
-		if(!displacement){
-			break;
-		}
-		if(!(*word)){
-			break;
-		}
+	while((tokenLength = nextToken(&tokens, &token))){
 		
-		/* add word's L1 RIV to the accumulating denseRIV */
-		addBarcodeToDense(denseTemp, word);
+		/* add word's L1 RIV to the accumulating denseRIV, straight from the text */
+		addBarcodeSpanToDense(denseTemp, token, tokenLength);
 		
 		
 		wordCount++;
@@ -118,28 +141,55 @@ sparseRIV* textToL2(char *text){
 	return output;
 }
 
+sparseRIV* wordsToL2(char** words, int wordCount){
+	int denseTemp[RIVSIZE] = {0};
+	
+	for(int i=0; i<wordCount; i++){
+		/* add word's L1 RIV to the accumulating denseRIV */
+		addBarcodeToDense(denseTemp, words[i]);
+	}
+	/*consolidate the dense form to a sparseRIV for output */
+	sparseRIV* output = consolidateD2S(denseTemp);
+
+	/* contextSize stores the number of words read */
+	output->contextSize = wordCount;
+	return output;
+}
+
 sparseRIV* fileToL2(FILE *data){
-	char word[100] = {0};
+	/* the file is read through the input layer from its start, mapped if it
+	 * can be, and left rewound for the caller as before */
+	fflush(data);
+	RIVinput* input = inputFromDescriptor(fileno(data));
+	sparseRIV* output = inputToL2(input);
+	inputClose(input);
+	
+	fseek(data, 0, SEEK_SET);
+	return output;
+}
 
+sparseRIV* inputToL2(RIVinput* input){
 	/* locations (implicit RIV) are temporarily stored in temp block, 
 	 * and moved to permanent home in consolidation */
 
 	int denseTemp[RIVSIZE] = {0};
 	int wordCount = 0;
-	while(fscanf(data, "%99s", word)){
-
-		if(feof(data)){
-			break;
-		}
-		if(!(*word)){
-			break;
+	
+	const char* block;
+	size_t blockLength;
+	const char* token;
+	size_t length;
+	RIVtokenizer tokens;
+	while((blockLength = inputNextBlock(input, &block))){
+		tokenizerInit(&tokens, block, blockLength);
+		while((length = nextToken(&tokens, &token))){
+
+			/* add the barcode form of this word to the accumulating denseRIV */
+			addBarcodeSpanToDense(denseTemp, token, length);
+			
+			
+			wordCount++;
 		}
-
-		/* add the barcode form of this word to the accumulating denseRIV */
-		addBarcodeToDense(denseTemp, word);
-		
-		
-		wordCount++;
 	}
 	
 	
@@ -148,7 +198,6 @@ sparseRIV* fileToL2(FILE *data){
 
 	/* contextSize records the number of words in this file */
 	output->contextSize = wordCount;
-	fseek(data, 0, SEEK_SET);
 	return output;
 }
 
@@ -185,19 +234,7 @@ sparseRIV* trueNormalize(denseRIV* input, double magnitude){
 	int* locations = tempBlock+RIVSIZE;
 	int* values = locations+RIVSIZE;
 	
-	int count = 0;
-	for(int i=0; i<RIVSIZE; i++){
-		/* if this point is 0, skip it */
-		if(!input->values[i]) continue;
-		
-		/* record position and value in the forming sparse vector */
-		locations[count] = i;
-		
-		values[count]= round(input->values[i]*multiplier);
-		
-		/* drop any 0 values */
-		if(values[count])count++; 
-	}
+	int count = scaleValues(input->values, NULL, RIVSIZE, multiplier, 0, values, locations);
 	
 	sparseRIV* output;
 	/* for memory conservation, both datasets are put inline with each other */
@@ -227,18 +264,7 @@ sparseRIV* normalize(denseRIV input, int factor){
 	int* locations = tempBlock+RIVSIZE;
 	int* values = locations+RIVSIZE;
 	
-	int count = 0;
-	for(int i=0; i<RIVSIZE; i++){
-		/* if this point is 0, skip it */
-		if(!input.values[i]) continue;
-		
-		/* record position and value in the forming sparse vector */
-		locations[count] = i;
-		values[count]= round(input.values[i]*multiplier);
-		
-		/* drop any 0 values */
-		if(values[count])count++; 
-	}
+	int count = scaleValues(input.values, NULL, RIVSIZE, multiplier, 1, values, locations);
 	sparseRIV* output = sparseAllocate(count);
 	
 	/* copy the data from tempBlock into permanent home */
@@ -253,6 +279,36 @@ sparseRIV* normalize(denseRIV input, int factor){
 	return output;
 }
 
+sparseRIV* normalizeSparse(sparseRIV* input, int factor){
+	/* the same scaling as normalize, value for value */
+	float multiplier = (float)factor/(input->contextSize);
+	return scaleSparse(input, multiplier, 1);
+}
+
+sparseRIV* trueNormalizeSparse(sparseRIV* input, double magnitude){
+	/* the same scaling as trueNormalize, value for value */
+	return scaleSparse(input, magnitude/getMagnitudeSparse(input), 0);
+}
+
+sparseRIV* scaleSparse(sparseRIV* input, double multiplier, int single){
+	/* room for every value; those which round to 0 leave some unused */
+	sparseRIV* output = sparseAllocate(input->count);
+	if(!output) return NULL;
+	size_t count = scaleValues(input->values, input->locations, input->count, multiplier, single, output->values, output->locations);
+	
+	/* the values follow the locations directly, as sparseAllocate(count) lays them */
+	memmove(output->locations+count, output->values, count*sizeof(int));
+	output->values = output->locations+count;
+	output->count = count;
+	
+	/* carry metadata */
+	strcpy(output->name, input->name);
+	output->magnitude = getMagnitudeSparse(output);
+	output->contextSize = input->contextSize;
+	output->frequency = input->frequency;
+	return output;
+}
+
 double sine(denseRIV* baseDense, sparseRIV* comparator){
 	double cos = cosCompare(baseDense, comparator);
 	return COS2SIN(cos);
@@ -260,49 +316,31 @@ double sine(denseRIV* baseDense, sparseRIV* comparator){
 		
 sparseRIV* line2L3(LEXICON* lexicon, char* text, RIVtree* stemRoot){
 	
-	/* wordRIV will be used as temporary storage for lexPull output */
-	denseRIV* wordRIV;
-	
 	/* vector will be summed in preparation for consolidation and output */
 	denseRIV accumulate = {0};
 	
-	/* pointer to null terminator */
-	char* textEnd = text+strlen(text);
-	char word[100];
-
-	/* will log the number of characters read in each word */
-	int displacement;
-	while(text<textEnd){
-		sscanf(text, "%99s%n", word, &displacement);
-		
-		/* shift forward by the number of characters read (+ a space!) */
-		text += displacement+1;
-		
-		/* if the word parses down to nothing, skip */
-		if(!clean(word)) continue;
-		char* stem;
-		if(stemRoot){
-			stem = treeSearch(stemRoot, word);
-		}else{
-			stem = word;
-		}
-		/* if the word stems to nothing (has no valid stem in the lexicon)
-		 * skip */
-		if(!stem) continue;
+	/* clean, lowercase and stem the words. those which parse down to nothing,
+	 * or have no valid stem in the lexicon, are dropped */
+	RIVbuffer buffer = {0};
+	RIVwords words = {0};
+	cleanToWords(stemRoot, text, strlen(text), &buffer, &words);
 	
-		/* retrieve the vector form of this word from the lexicon */
-		wordRIV = lexPull(lexicon, stem);
-		
-		if(!wordRIV) continue;
-		
-		/* add this vector to the accumulating text vector */
-		addRIV(&accumulate, wordRIV) 
-		
-		/* send the vector back to the lexicon */
-		lexPush(lexicon, wordRIV);
+	/* retrieve the vector forms of all the words from the lexicon at once */
+	denseRIV** wordRIVs = malloc((words.count+1)*sizeof(denseRIV*));
+	lexPullMany(lexicon, words.list, words.count, wordRIVs);
 	
+	for(int i=0; i<words.count; i++){
+		if(!wordRIVs[i]) continue;
 		
+		/* add this vector to the accumulating text vector */
+		addRIV(&accumulate, wordRIVs[i]) 
 	}
+	/* send the vectors back to the lexicon */
+	lexPushMany(lexicon, wordRIVs, words.count);
+	
+	free(wordRIVs);
+	free(words.list);
+	free(buffer.text);
 
 	/* reduce this vector to a sparse form and return */
 	return consolidateD2S(accumulate.values);
@@ -8,8 +8,11 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <time.h>
+#include <sys/stat.h>
 //RIVSIZE macro must be set to the size of the RIVs in the lexicon
+#ifndef RIVSIZE
 #define RIVSIZE 50000
+#endif
 #define CACHESIZE 0
 #define EPSILON 0.98
 #define MINPOINTS 1
@@ -38,7 +41,8 @@ void directoryToL2s(char *rootString, sparseRIV*** fileRIVs, int *fileCount, LEX
 
 int main(int argc, char *argv[]){
 	if(argc <2){
-		printf("argument to DensityClustering should be a RIV lexicon to be clustered");
+		printf("argument to DensityClustering should be a RIV lexicon to be clustered, or a collection\n");
+		printf("saved from one. given a second argument, the lexicon's vectors are saved there as a collection");
 		return 1;
 	}
 	int fileCount = 0;
@@ -46,19 +50,58 @@ int main(int argc, char *argv[]){
 	sparseRIV **fileRIVs = (sparseRIV**) malloc(1*sizeof(sparseRIV*));
 	char rootString[1000];
 	
-	//we open the lexicon under "read, exclusive" flags
-	LEXICON* lexicon = lexOpen(argv[1], "rx");
-	strcpy(rootString, argv[1]);
-	strcat(rootString, "/");
+	/* a collection saved by an earlier run holds the normalized vectors
+	 * already, and is read straight from the file */
+	RIVcollection* collection = NULL;
+	struct stat st;
+	if(!stat(argv[1], &st) && S_ISREG(st.st_mode)){
+		collection = collectionOpen(argv[1]);
+		if(!collection){
+			printf("could not read collection %s\n", argv[1]);
+			return 1;
+		}
+		fileCount = collection->count;
+		fileRIVs = (sparseRIV**) realloc(fileRIVs, (fileCount+1)*sizeof(sparseRIV*));
+		for(int i = 0; i < fileCount; i++){
+			if(!(fileRIVs[i] = collectionGet(collection, i))){
+				printf("collection %s is corrupt\n", argv[1]);
+				return 1;
+			}
+		}
+	}else{
+		//we open the lexicon under "read, exclusive" flags
+		LEXICON* lexicon = lexOpen(argv[1], "rx");
+		if(!lexicon){
+			printf("could not open lexicon %s\n", argv[1]);
+			return 1;
+		}
+		strcpy(rootString, argv[1]);
+		strcat(rootString, "/");
 
-	directoryToL2s(rootString, &fileRIVs, &fileCount, lexicon);
+		directoryToL2s(rootString, &fileRIVs, &fileCount, lexicon);
+		
+		if(argc > 2){
+			RIVcollectionWriter* output = collectionCreate(argv[2]);
+			int failed = !output;
+			for(int i = 0; !failed && i < fileCount; i++){
+				failed = collectionAppend(output, fileRIVs[i]);
+			}
+			if(output && collectionFinish(output)) failed = 1;
+			if(failed){
+				printf("could not save collection %s\n", argv[2]);
+			}
+		}
+	}
 	printf("fileCount: %d\n", fileCount);
 	/* an array of nodes, one for each vector */
 	struct DBnode DBset[fileCount];
 	
 	/* fill the node array with vectors and initialize metadata */
 	for(int i = 0; i < fileCount; i++){
-		fileRIVs[i]->magnitude = RIVMagnitude(fileRIVs[i]);
+		/* (a collection's vectors carry their magnitudes) */
+		if(!collection){
+			fileRIVs[i]->magnitude = RIVMagnitude(fileRIVs[i]);
+		}
 		DBset[i].RIV = fileRIVs[i];
 		/* a single malloc for later realloc'ing */
 		DBset[i].neighbors = malloc(sizeof(struct DBnode*));
@@ -132,12 +175,15 @@ void directoryToL2s(char *rootString, sparseRIV*** fileRIVs, int *fileCount, LEX
 			continue;
 		}
 		/* end dirent walk, begin meat of the function */
-		denseRIV* temp = lexPull(lexicon, files->d_name);
+		/* the lexicon is only read, so each vector is taken sparse, as stored,
+		 * and never made dense */
+		sparseRIV* temp = lexPullSparse(lexicon, files->d_name);
+		if(!temp) continue;
 		/* if the vector has been encountered more than MINSIZE times
 		 * then it should be statistically significant, and useful */
 		if(temp->contextSize >MINSIZE){
 			(*fileRIVs) = (sparseRIV**)realloc((*fileRIVs), ((*fileCount)+1)*sizeof(sparseRIV*));
-			(*fileRIVs)[(*fileCount)] = normalize(*temp, 500);
+			(*fileRIVs)[(*fileCount)] = normalizeSparse(temp, 500);
 			strcpy((*fileRIVs)[(*fileCount)]->name, files->d_name);
 			(*fileCount)++;
 		}
@@ -147,11 +193,11 @@ void directoryToL2s(char *rootString, sparseRIV*** fileRIVs, int *fileCount, LEX
 
 void intercompare(struct DBnode* DBset, int nodeCount){
 	double cosine;
-	denseRIV baseDense;
+	denseRIV baseDense = {0};
 	for(int i=0; i<nodeCount; i++){
 		/* map the RIV in question to a dense for comparison */
 		memset(baseDense.values, 0, RIVSIZE*sizeof(int));
-		addS2D(baseDense.values, DBset[i].RIV);
+		addS2D(&baseDense, DBset[i].RIV);
 		baseDense.magnitude = DBset[i].RIV->magnitude;
 		/* for each previous vector */
 		for(int j=i+1; j<nodeCount; j++){
@@ -2,77 +2,145 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <time.h>
+#include <sys/stat.h>
 #define THRESHOLD 0.7
+//STREAMWINDOW is the number of recent documents each streamed document is compared with
+#ifndef STREAMWINDOW
+#define STREAMWINDOW 10000
+#endif
 #include "../RIVtools.h"
 
 /* this program identifies all near-duplicates among the documents in the 
  * chosen root directory, using RIV comparison although this is meant for
  * demonstration purposes, it can easily be repurposed to remove 
- * near-duplicates that it finds */
+ * near-duplicates that it finds. the documents' vectors may be saved as a
+ * collection (see RIVcollection.h), and later runs given the collection
+ * in place of the directory, to skip straight to comparison.
+ * in stream mode (-s), documents are read one per line from a file or stdin,
+ * and each is compared as it arrives with the latest documents before it,
+ * so that duplicates are printed at once, in constant memory */
 
-// fills the fileRIVs array with a vector for each file in the root directory
-void directoryToL2s(char *rootString, sparseRIV** fileRIVs, int *fileCount);
+// fills the fileRIVs array with a vector for each file in the root directory,
+// each named by its path within the first rootLength characters of rootString
+void directoryToL2s(char *rootString, size_t rootLength, sparseRIV*** fileRIVs, int *fileCount);
+
+// compares each line of input with the "window" lines before it, printing duplicates as found
+void streamCull(RIVinput* input, int window, int named);
 
 int main(int argc, char *argv[]){
 	
 	int fileCount = 0;
 	
 	//initializes the fileRIVs array to be reallocced by later function
-	sparseRIV *fileRIVs = (sparseRIV*) malloc(1*sizeof(sparseRIV));
+	sparseRIV **fileRIVs = (sparseRIV**) malloc(1*sizeof(sparseRIV*));
 	char rootString[2000];
 	if(argc <2){ 
-		printf("give me a directory");
+		printf("give me a directory, or a collection, and optionally a collection to save\n");
+		printf("or -s [-n] <file, or - for stdin> [window] to stream one document per line\n");
+		printf("with -n, a line of \"name<tab>text\" is named by its name, rather than its line number");
 		return 1;
 	}
-	strcpy(rootString, argv[1]);
-	strcat(rootString, "/");
+	if(!strcmp(argv[1], "-s")){
+		int named = argc > 2 && !strcmp(argv[2], "-n");
+		if(argc < 3+named){
+			printf("give me a file to stream, or - for stdin");
+			return 1;
+		}
+		RIVinput* input = inputOpen(argv[2+named]);
+		if(!input){
+			printf("location not found, %s\n", argv[2+named]);
+			return 1;
+		}
+		int window = argc > 3+named? atoi(argv[3+named]): STREAMWINDOW;
+		streamCull(input, window > 0? window: STREAMWINDOW, named);
+		inputClose(input);
+		free(fileRIVs);
+		return 0;
+	}
+	RIVcollection* collection = NULL;
+	struct stat st;
+	if(!stat(argv[1], &st) && S_ISREG(st.st_mode)){
+		//a saved collection is used as it is, its vectors read straight from the file
+		collection = collectionOpen(argv[1]);
+		if(!collection){
+			printf("could not read the collection %s\n", argv[1]);
+			return 1;
+		}
+		fileCount = collection->count;
+		fileRIVs = (sparseRIV**) realloc(fileRIVs, (fileCount+1)*sizeof(sparseRIV*));
+		for(int i = 0; i < fileCount; i++){
+			if(!(fileRIVs[i] = collectionGet(collection, i))){
+				printf("the collection %s is corrupt\n", argv[1]);
+				return 1;
+			}
+		}
+		printf("fileCount: %d\n", fileCount);
+	}else{
+		strcpy(rootString, argv[1]);
+		strcat(rootString, "/");
 
-	//gather all vectors ino the fileRIVs array and count them in fileCount
-	directoryToL2s(rootString, &fileRIVs, &fileCount);
-	printf("fileCount: %d\n", fileCount);
-	
-	//first calculate all magnitudes for later use
-	for(int i = 0; i < fileCount; i++){
-		fileRIVs[i].magnitude = getMagnitudeSparse(fileRIVs[i]);
+		//gather all vectors ino the fileRIVs array and count them in fileCount
+		directoryToL2s(rootString, strlen(rootString), &fileRIVs, &fileCount);
+		printf("fileCount: %d\n", fileCount);
 		
+		//first calculate all magnitudes for later use
+		for(int i = 0; i < fileCount; i++){
+			fileRIVs[i]->magnitude = getMagnitudeSparse(fileRIVs[i]);
+			
+		}
+		//and save the vectors, if asked, for later runs
+		if(argc > 2){
+			RIVcollectionWriter* output = collectionCreate(argv[2]);
+			int failed = !output;
+			for(int i = 0; !failed && i < fileCount; i++){
+				failed = collectionAppend(output, fileRIVs[i]);
+			}
+			if(output && collectionFinish(output)) failed = 1;
+			if(failed){
+				printf("could not save the collection %s\n", argv[2]);
+			}
+		}
 	}
 	clock_t begintotal = clock();
 	double cosine;
-	double minmag;
-	double maxmag;
 	
 	//all cosines need a sparse-dense comparison.  so we will create a 
 	denseRIV baseDense;
+	memset(&baseDense, 0, sizeof(denseRIV));
 		
 	for(int i = 0; i < fileCount; i++){
+		if(bandEmpty(fileRIVs[i])) continue;
 		
-		//0 out the denseVector, and map the next sparseVector to it
-		memset(&baseDense, 0, sizeof(denseRIV));
-		addS2D(baseDense.values, fileRIVs[i]);
-		
-		//pass magnitude to the to the dense vector
-		baseDense.magnitude = fileRIVs[i].magnitude;
+		//map the next sparseVector to the denseVector, with its magnitude
+		bandProbe(&baseDense, fileRIVs[i]);
 		
 		//if these two vectors are too different in size, we can know that they are not duplicates
-		minmag = baseDense.magnitude*.85;
-		maxmag  = baseDense.magnitude*1.15;
+		magnitudeBand band = bandAround(baseDense.magnitude, BANDWIDTH);
 		for(int j = 0; j < i; j++){
 			//if this vector is within magnitude threshold
-			if(fileRIVs[j].magnitude < maxmag 
-			&& fileRIVs[j].magnitude > minmag){
+			if(bandHolds(band, fileRIVs[j]->magnitude)){
 				
 				//identify the similarity of these two vectors
-				cosine = cosCompare(&baseDense, &fileRIVs[j]);
+				cosine = cosCompare(&baseDense, fileRIVs[j]);
 								
 		
 				//if the two are similar enough to be flagged
 				if(cosine>THRESHOLD){
-					printf("%s\t%s\n%f\n", fileRIVs[i].name , fileRIVs[j].name, cosine);
+					printf("%s\t%s\n%f\n", fileRIVs[i]->name , fileRIVs[j]->name, cosine);
 				}	
 			}
 		}
+		//and 0 it out again, for the next
+		bandRelease(&baseDense, fileRIVs[i]);
 	}
 	printf("fileCount: %d", fileCount);
+	if(collection){
+		collectionClose(collection);
+	}else{
+		for(int i = 0; i < fileCount; i++){
+			free(fileRIVs[i]);
+		}
+	}
 	free(fileRIVs);
 	clock_t endtotal = clock();
 	double time_spent = (double)(endtotal - begintotal) / CLOCKS_PER_SEC;
@@ -81,7 +149,7 @@ return 0;
 }
 
 //mostly a standard recursive Dirent-walk
-void directoryToL2s(char *rootString, sparseRIV** fileRIVs, int *fileCount){
+void directoryToL2s(char *rootString, size_t rootLength, sparseRIV*** fileRIVs, int *fileCount){
 /* *** begin Dirent walk *** */
 	char pathString[2000];
 	DIR *directory;
@@ -94,19 +162,14 @@ void directoryToL2s(char *rootString, sparseRIV** fileRIVs, int *fileCount){
 
 	while((files=readdir(directory))){
 		
-		if(!files->d_name[0]) break;
-		while(*(files->d_name)=='.'){
-			files = readdir(directory);
-		}
-		
-		
+		if(*(files->d_name) == '.') continue;
 		
 		if(files->d_type == DT_DIR){
 			strcpy(pathString, rootString);
 
 			strcat(pathString, files->d_name);
 			strcat(pathString, "/");
-			directoryToL2s(pathString, fileRIVs, fileCount);
+			directoryToL2s(pathString, rootLength, fileRIVs, fileCount);
 			continue;
 		}
 		strcpy(pathString, rootString);
@@ -114,16 +177,78 @@ void directoryToL2s(char *rootString, sparseRIV** fileRIVs, int *fileCount){
 
 /* *** end dirent walk, begin meat of function  *** */
 
-		FILE *input = fopen(pathString, "r");
+		//files are named by their paths below the root, which must fit the RIV's name
+		char* name = pathString+rootLength;
+		if(strlen(name) >= sizeof((*fileRIVs)[0]->name)){
+			printf("name too long, skipped: %s\n", name);
+			continue;
+		}
+		RIVinput *input = inputOpen(pathString);
 		if(input){
 			
-			*fileRIVs = (sparseRIV*)realloc((*fileRIVs), ((*fileCount)+1)*sizeof(sparseRIV));
+			*fileRIVs = (sparseRIV**)realloc((*fileRIVs), ((*fileCount)+1)*sizeof(sparseRIV*));
 			
-			(*fileRIVs)[*fileCount] = fileToL2(input);
-			strcpy((*fileRIVs)[*fileCount].name, pathString);
+			(*fileRIVs)[*fileCount] = inputToL2(input);
+			snprintf((*fileRIVs)[*fileCount]->name, sizeof((*fileRIVs)[0]->name), "%s", name);
 			
-			fclose(input);
+			inputClose(input);
 			 *fileCount += 1;
 		}
 	}
+	closedir(directory);
+}
+void streamCull(RIVinput* input, int window, int named){
+	//the window is a ring of the latest vectors. their magnitudes are kept apart,
+	//so that the magnitude check runs through contiguous memory
+	sparseRIV** recent = calloc(window, sizeof(sparseRIV*));
+	float* magnitudes = calloc(window, sizeof(float));
+	int held = 0;
+	int oldest = 0;
+	denseRIV* baseDense = calloc(1, sizeof(denseRIV));
+	
+	const char* line;
+	size_t length;
+	long lineNumber = 0;
+	double cosine;
+	while((length = inputNextLine(input, &line))){
+		lineNumber++;
+		//named just as RIVvectorize names the lines it reads
+		char name[100];
+		length = documentName(&line, length, named, lineNumber, name);
+		sparseRIV* vector = spanToL2(line, length);
+		strcpy(vector->name, name);
+		vector->magnitude = getMagnitudeSparse(vector);
+		if(bandEmpty(vector)){
+			free(vector);
+			continue;
+		}
+		
+		//the window is in no order, so each magnitude is tested against the band
+		bandProbe(baseDense, vector);
+		magnitudeBand band = bandAround(vector->magnitude, BANDWIDTH);
+		for(int j = 0; j < held; j++){
+			if(bandHolds(band, magnitudes[j])){
+				cosine = cosCompare(baseDense, recent[j]);
+				if(cosine>THRESHOLD){
+					printf("%s\t%s\n%f\n", vector->name, recent[j]->name, cosine);
+					//in a pipe, every duplicate is passed on as soon as it is found
+					fflush(stdout);
+				}
+			}
+		}
+		bandRelease(baseDense, vector);
+		
+		//the newest document takes the place of the oldest
+		free(recent[oldest]);
+		recent[oldest] = vector;
+		magnitudes[oldest] = vector->magnitude;
+		oldest = (oldest+1)%window;
+		if(held < window) held++;
+	}
+	for(int i = 0; i < held; i++){
+		free(recent[i]);
+	}
+	free(recent);
+	free(magnitudes);
+	free(baseDense);
 }
@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <string.h>
+#include "../RIVtools.h"
+
+/* this program checks a day's (or any batch's) new documents for near-duplicates
+ * against every document seen before, as held in a dedup index (see RIVdedup.h),
+ * and among themselves.  only the new documents are read and vectorized, and
+ * unless only checking, they are then added to the index for later batches.
+ * an index is compacted on its own as segments pile up, or at once with -c */
+
+// fills the fileRIVs array with a vector for each file in the root directory,
+// each named by its path within the first rootLength characters of rootString
+void directoryToL2s(char *rootString, size_t rootLength, sparseRIV*** fileRIVs, int *fileCount);
+
+int main(int argc, char *argv[]){
+	if(argc == 3 && !strcmp(argv[1], "-c")){
+		dedupIndex* index = dedupOpen(argv[2]);
+		if(!index){
+			printf("could not open the index %s\n", argv[2]);
+			return 1;
+		}
+		int failed = dedupCompact(index);
+		if(failed){
+			printf("could not compact the index %s\n", argv[2]);
+		}
+		dedupClose(index);
+		return failed;
+	}
+	if(argc < 3){
+		puts("correct usage:");
+		puts("./RIVdedup <indexDirectory> <directoryOfNewDocuments> [check]");
+		puts("./RIVdedup -c <indexDirectory>");
+		puts("duplicates are printed as \"new document<tab>duplicate<tab>cosine\"");
+		puts("the new documents are added to the index, unless \"check\" is given");
+		puts("with -c, the index's segments are compacted into one");
+		return 1;
+	}
+	int checkOnly = argc > 3 && !strcmp(argv[3], "check");
+	
+	dedupIndex* index = dedupOpen(argv[1]);
+	if(!index){
+		printf("could not open the index %s\n", argv[1]);
+		return 1;
+	}
+	
+	int fileCount = 0;
+	sparseRIV **fileRIVs = (sparseRIV**) malloc(1*sizeof(sparseRIV*));
+	char rootString[2000];
+	strcpy(rootString, argv[2]);
+	strcat(rootString, "/");
+	directoryToL2s(rootString, strlen(rootString), &fileRIVs, &fileCount);
+	for(int i = 0; i < fileCount; i++){
+		fileRIVs[i]->magnitude = getMagnitudeSparse(fileRIVs[i]);
+	}
+	
+	int duplicates = dedupCheck(index, fileRIVs, fileCount, stdout);
+	fprintf(stderr, "%d new documents, %d duplicates\n", fileCount, duplicates);
+	
+	int failed = 0;
+	if(!checkOnly && fileCount){
+		if(dedupAdd(index, fileRIVs, fileCount)){
+			printf("could not add the documents to the index %s\n", argv[1]);
+			failed = 1;
+		}
+	}
+	for(int i = 0; i < fileCount; i++){
+		free(fileRIVs[i]);
+	}
+	free(fileRIVs);
+	dedupClose(index);
+	return failed;
+}
+
+//mostly a standard recursive Dirent-walk
+void directoryToL2s(char *rootString, size_t rootLength, sparseRIV*** fileRIVs, int *fileCount){
+	char pathString[2000];
+	DIR *directory;
+	struct dirent *files = 0;
+
+	if(!(directory = opendir(rootString))){
+		printf("location not found, %s\n", rootString);
+		return;
+	}
+
+	while((files=readdir(directory))){
+		
+		if(*(files->d_name) == '.') continue;
+		
+		if(files->d_type == DT_DIR){
+			strcpy(pathString, rootString);
+
+			strcat(pathString, files->d_name);
+			strcat(pathString, "/");
+			directoryToL2s(pathString, rootLength, fileRIVs, fileCount);
+			continue;
+		}
+		strcpy(pathString, rootString);
+		strcat(pathString, files->d_name);
+
+		//documents are named by their paths below the root, which must fit the
+		//RIV's name, or two documents could be stored under one name
+		char* name = pathString+rootLength;
+		if(strlen(name) >= sizeof((*fileRIVs)[0]->name)){
+			fprintf(stderr, "name too long, skipped: %s\n", name);
+			continue;
+		}
+		RIVinput *input = inputOpen(pathString);
+		if(input){
+			
+			*fileRIVs = (sparseRIV**)realloc((*fileRIVs), ((*fileCount)+1)*sizeof(sparseRIV*));
+			
+			(*fileRIVs)[*fileCount] = inputToL2(input);
+			snprintf((*fileRIVs)[*fileCount]->name, sizeof((*fileRIVs)[0]->name), "%s", name);
+			
+			inputClose(input);
+			 *fileCount += 1;
+		}
+	}
+	closedir(directory);
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#define THRESHOLD 0.7
+#include "../RIVtools.h"
+
+/* this program finds every document of one collection (see RIVcollection.h)
+ * with a near-duplicate in another: which documents of a new crawl are
+ * already in an archive, say.  collections are made by RIVcull from a
+ * directory, or by RIVvectorize from a corpus; this program must be built
+ * with the RIVSIZE of the collections it joins (-DRIVSIZE=60000 for those of
+ * RIVvectorize).  the pairs are printed as "name in A<tab>name in B<tab>cosine",
+ * or with -b written as a binary list of joinPairs (see RIVjoin.h) */
+
+int main(int argc, char *argv[]){
+	//with -b, pairs are written in binary
+	int binary = 0;
+	if(argc > 1 && !strcmp(argv[1], "-b")){
+		binary = 1;
+		argc--;
+		argv++;
+	}
+	if(argc < 3){
+		puts("correct usage:");
+		puts("./RIVjoin [-b] <collectionA> <collectionB> [threshold] [threads]");
+		puts("pairs are printed as \"name in A<tab>name in B<tab>cosine\"");
+		puts("with -b, they are written to stdout as binary joinPairs, of indexes into A and B");
+		return 1;
+	}
+	double threshold = argc > 3? atof(argv[3]): THRESHOLD;
+	int threadCount = argc > 4? atoi(argv[4]): 0;
+
+	RIVcollection* setA = collectionOpen(argv[1]);
+	if(!setA){
+		fprintf(stderr, "could not open the collection %s\n", argv[1]);
+		return 1;
+	}
+	RIVcollection* setB = collectionOpen(argv[2]);
+	if(!setB){
+		fprintf(stderr, "could not open the collection %s\n", argv[2]);
+		collectionClose(setA);
+		return 1;
+	}
+
+	clock_t begintotal = clock();
+	long found = collectionJoin(setA, setB, threshold, threadCount, stdout, binary);
+	double time = (double)(clock() - begintotal) / CLOCKS_PER_SEC;
+	if(found < 0){
+		fprintf(stderr, "the join failed: a collection is corrupt, or the output could not be written\n");
+	}else{
+		fprintf(stderr, "%zu x %zu documents, %ld pairs, %lf seconds of processor time\n",
+			setA->count, setB->count, found, time);
+	}
+	collectionClose(setA);
+	collectionClose(setB);
+	return found < 0;
+}
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+
+//RIVSIZE and NONZEROS are left to the command line (-DRIVSIZE=...), so that
+//benchSweep.sh can build this once for each size to be measured
+#define CACHESIZE 0
+#include "../../RIVtools.h"
+
+//this program times the core vector kernels, over vectors of a range of
+//saturations (nnz, the number of non-zero values), and prints the results as
+//one JSON object, so that runs can be kept and compared across kernel variants
+//usage: ./RIVbench [nnz ...]
+
+//BENCHTIME is the least time (in seconds) that each measurement runs for
+#ifndef BENCHTIME
+#define BENCHTIME 0.05
+#endif
+//BENCHRUNS measurements are made of each kernel, and the best and median kept
+#ifndef BENCHRUNS
+#define BENCHRUNS 5
+#endif
+
+//the shape of one kernel being measured. "setup" prepares the inputs for a
+//given size, and "kernel" is run repeatedly against them
+struct benchCase{
+	const char* name;
+	//what "size" counts, for this kernel: nnz, or words
+	const char* unit;
+	void (*setup)(int size);
+	void (*kernel)();
+};
+
+void benchOne(struct benchCase* bench, int size, int* first);
+double benchNow();
+sparseRIV* randomSparse(int nnz);
+void randomDense(denseRIV* output, int nnz);
+void cleanupLexicon();
+
+//the inputs every kernel works on, rebuilt by each setup
+denseRIV* denseA;
+denseRIV* denseB;
+sparseRIV* sparseA;
+sparseRIV* sparseB;
+int* stagingBlock;
+char* benchText;
+LEXICON* benchLexicon;
+char benchLexName[] = "/tmp/RIVbenchXXXXXX";
+//a sink for results, so that the compiler cannot drop the kernels
+volatile double benchSink;
+
+void setupVectors(int nnz){
+	randomDense(denseA, nnz);
+	randomDense(denseB, nnz);
+	free(sparseA);
+	free(sparseB);
+	sparseA = randomSparse(nnz);
+	sparseB = randomSparse(nnz);
+}
+//the same, with denseA tracked (see denseTrack)
+void setupTracked(int nnz){
+	setupVectors(nnz);
+	denseTrack(denseA);
+}
+//the text kernels are given "size" words, of 3 to 10 letters
+void setupText(int words){
+	free(benchText);
+	benchText = malloc(words*11+1);
+	char* cursor = benchText;
+	for(int i=0; i<words; i++){
+		int length = 3+rand()%8;
+		for(int j=0; j<length; j++){
+			*(cursor++) = 'a'+rand()%26;
+		}
+		*(cursor++) = ' ';
+	}
+	*cursor = 0;
+}
+void setupLexicon(int nnz){
+	randomDense(denseA, nnz);
+	strcpy(denseA->name, "benchword");
+	//one copy is pushed, so that there is something to pull
+	denseRIV* copy = malloc(sizeof(denseRIV));
+	memcpy(copy, denseA, sizeof(denseRIV));
+	fLexPush(benchLexicon, copy);
+}
+void setupLexiconTracked(int nnz){
+	setupLexicon(nnz);
+	denseTrack(denseA);
+}
+
+void kernelConsolidate(){
+	sparseRIV* output = consolidateD2S(denseA->values);
+	benchSink = output->count;
+	free(output);
+}
+void kernelAddS2D(){
+	addS2D(denseA, sparseA);
+}
+void kernelAddD2D(){
+	addD2D(denseA, denseB);
+}
+void kernelCosS2D(){
+	benchSink = cosCompareS2D(denseA, sparseA);
+}
+void kernelCosD2D(){
+	benchSink = cosCompareD2D(denseA, denseB);
+}
+void kernelCosS2S(){
+	benchSink = cosCompareS2S(sparseA, sparseB);
+}
+void kernelMagnitudeDense(){
+	benchSink = getMagnitudeDense(denseA);
+}
+void kernelMagnitudeSparse(){
+	benchSink = getMagnitudeSparse(sparseA);
+}
+void kernelBarcode(){
+	addBarcodeToDense(denseB->values, "benchmark");
+}
+void kernelTextToL2(){
+	sparseRIV* output = textToL2(benchText);
+	benchSink = output->count;
+	free(output);
+}
+void kernelSaturation(){
+	benchSink = saturationForStaging(denseA, stagingBlock+RIVSIZE);
+}
+//each push includes the copy that fLexPush frees, as any real push would
+void kernelPush(){
+	denseRIV* copy = malloc(sizeof(denseRIV));
+	memcpy(copy, denseA, sizeof(denseRIV));
+	fLexPush(benchLexicon, copy);
+}
+//and each pull the opening of its file, as lexPull must
+void kernelPull(){
+	char pathString[200];
+	sprintf(pathString, "%s/benchword", benchLexName);
+	FILE* lexWord = fopen(pathString, "rb");
+	denseRIV* output = fLexPull(lexWord);
+	fclose(lexWord);
+	benchSink = output->frequency;
+	free(output);
+}
+
+struct benchCase benches[] = {
+	{"consolidateD2S", "nnz", setupVectors, kernelConsolidate},
+	{"addS2D", "nnz", setupVectors, kernelAddS2D},
+	{"addS2DTracked", "nnz", setupTracked, kernelAddS2D},
+	{"addD2D", "nnz", setupVectors, kernelAddD2D},
+	{"cosCompareS2D", "nnz", setupVectors, kernelCosS2D},
+	{"cosCompareD2D", "nnz", setupVectors, kernelCosD2D},
+	{"cosCompareS2S", "nnz", setupVectors, kernelCosS2S},
+	{"getMagnitudeDense", "nnz", setupVectors, kernelMagnitudeDense},
+	{"getMagnitudeDenseTracked", "nnz", setupTracked, kernelMagnitudeDense},
+	{"getMagnitudeSparse", "nnz", setupVectors, kernelMagnitudeSparse},
+	{"addBarcodeToDense", "nnz", setupVectors, kernelBarcode},
+	{"saturationForStaging", "nnz", setupVectors, kernelSaturation},
+	{"fLexPush", "nnz", setupLexicon, kernelPush},
+	{"fLexPushTracked", "nnz", setupLexiconTracked, kernelPush},
+	{"fLexPull", "nnz", setupLexicon, kernelPull},
+	{"textToL2", "words", setupText, kernelTextToL2},
+};
+
+int main(int argc, char *argv[]){
+	//by default, a near-empty, a typical and a half-saturated vector
+	int defaultSizes[] = {16, 1024, RIVSIZE/2};
+	int* sizes = defaultSizes;
+	int sizeCount = 3;
+	if(argc > 1){
+		sizeCount = argc-1;
+		sizes = malloc(sizeCount*sizeof(int));
+		for(int i=0; i<sizeCount; i++){
+			sizes[i] = atoi(argv[i+1]);
+			if(sizes[i] < 1 || sizes[i] > RIVSIZE){
+				fprintf(stderr, "nnz must be between 1 and RIVSIZE (%d)\n", RIVSIZE);
+				return 1;
+			}
+		}
+	}
+	int textSizes[] = {10, 100, 1000};
+
+	denseA = malloc(sizeof(denseRIV));
+	denseB = malloc(sizeof(denseRIV));
+	stagingBlock = malloc((3*RIVSIZE+5)*sizeof(int));
+	if(!mkdtemp(benchLexName)){
+		puts("could not create a temporary lexicon");
+		return 1;
+	}
+	benchLexicon = lexOpen(benchLexName, "rw");
+
+	printf("{\"RIVSIZE\": %d, \"NONZEROS\": %d, \"compiler\": \"%s\", \"results\": [", RIVSIZE, NONZEROS, __VERSION__);
+	int first = 1;
+	for(size_t i=0; i<sizeof(benches)/sizeof(*benches); i++){
+		if(!strcmp(benches[i].unit, "words")){
+			for(int j=0; j<3; j++){
+				benchOne(&benches[i], textSizes[j], &first);
+			}
+		}else{
+			for(int j=0; j<sizeCount; j++){
+				benchOne(&benches[i], sizes[j], &first);
+			}
+		}
+	}
+	puts("\n]}");
+
+	lexClose(benchLexicon);
+	cleanupLexicon();
+	return 0;
+}
+
+void benchOne(struct benchCase* bench, int size, int* first){
+	//the same inputs for every build, so that results are comparable
+	srand(size);
+	bench->setup(size);
+
+	//the number of calls per measurement is doubled until it lasts BENCHTIME
+	long iterations = 1;
+	double elapsed;
+	while(1){
+		double start = benchNow();
+		for(long i=0; i<iterations; i++){
+			bench->kernel();
+		}
+		elapsed = benchNow()-start;
+		if(elapsed >= BENCHTIME) break;
+		iterations *= 2;
+	}
+	double runs[BENCHRUNS];
+	for(int run=0; run<BENCHRUNS; run++){
+		//the accumulating kernels are reset, so that values cannot overflow
+		if(run) bench->setup(size);
+		double start = benchNow();
+		for(long i=0; i<iterations; i++){
+			bench->kernel();
+		}
+		runs[run] = (benchNow()-start)*1e9/iterations;
+	}
+	//sorted, for the best and the median
+	for(int i=1; i<BENCHRUNS; i++){
+		for(int j=i; j && runs[j] < runs[j-1]; j--){
+			double swap = runs[j];
+			runs[j] = runs[j-1];
+			runs[j-1] = swap;
+		}
+	}
+	printf("%s\n  {\"kernel\": \"%s\", \"%s\": %d, \"iterations\": %ld, \"runs\": %d, \"min_ns\": %.1f, \"median_ns\": %.1f}",
+		*first? "": ",", bench->name, bench->unit, size, iterations, BENCHRUNS, runs[0], runs[BENCHRUNS/2]);
+	*first = 0;
+	fflush(stdout);
+}
+
+double benchNow(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec+now.tv_nsec*1e-9;
+}
+
+//values are small (+-1 to +-8), as they are in real contexts
+int randomValue(){
+	int value = 1+rand()%8;
+	return rand()%2? value: -value;
+}
+
+sparseRIV* randomSparse(int nnz){
+	//locations are distinct and ascending, as consolidateD2S leaves them
+	denseRIV* temp = calloc(1, sizeof(denseRIV));
+	randomDense(temp, nnz);
+	sparseRIV* output = consolidateD2S(temp->values);
+	free(temp);
+	output->magnitude = getMagnitudeSparse(output);
+	return output;
+}
+
+void randomDense(denseRIV* output, int nnz){
+	memset(output, 0, sizeof(denseRIV));
+	int placed = 0;
+	while(placed < nnz){
+		int location = rand()%RIVSIZE;
+		if(output->values[location]) continue;
+		output->values[location] = randomValue();
+		placed++;
+	}
+	output->frequency = 1;
+	output->contextSize = 1;
+	output->magnitude = getMagnitudeDense(output);
+}
+
+void cleanupLexicon(){
+	DIR* directory = opendir(benchLexName);
+	if(directory){
+		struct dirent* files;
+		char pathString[300];
+		while((files = readdir(directory))){
+			if(!strcmp(files->d_name, ".") || !strcmp(files->d_name, "..")) continue;
+			sprintf(pathString, "%s/%s", benchLexName, files->d_name);
+			unlink(pathString);
+		}
+		closedir(directory);
+	}
+	rmdir(benchLexName);
+}
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+//this program measures how the RIV tools scale.  it builds RIVread, RIVcull and
+//DensityClustering for each RIVSIZE and CACHESIZE, generates synthetic corpora
+//(see zipfCorpus.c) of each shape, runs every tool over every corpus, and prints
+//a JSON array with one object per run: throughput, peak memory, and I/O
+//usage: ./RIVscale <workDirectory> [-v vocabularies] [-d documents] [-l linesPerDocument]
+//       [-w wordsPerLine] [-r RIVSIZEs] [-c CACHESIZEs] [-s exponent] [-S sourceDirectory]
+//lists are comma separated, and every combination of them is run.  the source
+//directory is RIVet-C's src directory, by default "../.." (from this directory)
+//the compiler is $CC, or gcc
+
+#define MAXLIST 32
+//a RIVSIZE or CACHESIZE left to the source's own default when building
+#define TOOLDEFAULT -1
+
+struct runStats{
+	int status;
+	double seconds;
+	double userSeconds;
+	double systemSeconds;
+	long maxRSS;
+	//bytes read and written by any means, and those that reached a block device
+	long long readBytes;
+	long long writeBytes;
+	long long blockReadBytes;
+	long long blockWriteBytes;
+};
+
+//the shape of one corpus
+struct corpusShape{
+	int vocabulary;
+	int documents;
+	int lines;
+	int lineWords;
+	long long words;
+	long long bytes;
+};
+
+int parseList(char* text, int* list);
+int runCommand(char* const argv[], const char* logName, struct runStats* stats);
+int buildTool(const char* source, const char* output, int rivSize, int cacheSize);
+int makeCorpus(struct corpusShape* shape, const char* directory, double exponent);
+void removeDirectory(const char* name);
+void printRun(const char* tool, struct corpusShape* shape, int rivSize, int cacheSize, struct runStats* stats, long long units, double hitRate);
+double cacheHitRate(const char* logName);
+double timeNow();
+
+const char* sourceDirectory = "../..";
+const char* workDirectory;
+int firstRun = 1;
+
+int main(int argc, char *argv[]){
+	if(argc < 2 || *argv[1] == '-'){
+		puts("correct usage:");
+		puts("./RIVscale <workDirectory> [-v vocabularies] [-d documents] [-l linesPerDocument] [-w wordsPerLine] [-r RIVSIZEs] [-c CACHESIZEs] [-s exponent] [-S sourceDirectory]");
+		return 1;
+	}
+	workDirectory = argv[1];
+	int vocabularies[MAXLIST] = {1000, 10000};
+	int vocabularyCount = 2;
+	int documents[MAXLIST] = {100};
+	int documentCount = 1;
+	int lines[MAXLIST] = {20};
+	int lineCount = 1;
+	int lineWords[MAXLIST] = {15};
+	int lineWordCount = 1;
+	int rivSizes[MAXLIST] = {25000};
+	int rivSizeCount = 1;
+	int cacheSizes[MAXLIST] = {1000, 10000};
+	int cacheSizeCount = 2;
+	double exponent = 1.0;
+
+	for(int i=2; i+1<argc; i+=2){
+		char* option = argv[i];
+		char* value = argv[i+1];
+		if(!strcmp(option, "-v")) vocabularyCount = parseList(value, vocabularies);
+		else if(!strcmp(option, "-d")) documentCount = parseList(value, documents);
+		else if(!strcmp(option, "-l")) lineCount = parseList(value, lines);
+		else if(!strcmp(option, "-w")) lineWordCount = parseList(value, lineWords);
+		else if(!strcmp(option, "-r")) rivSizeCount = parseList(value, rivSizes);
+		else if(!strcmp(option, "-c")) cacheSizeCount = parseList(value, cacheSizes);
+		else if(!strcmp(option, "-s")) exponent = atof(value);
+		else if(!strcmp(option, "-S")) sourceDirectory = value;
+		else{
+			printf("unknown option %s\n", option);
+			return 1;
+		}
+	}
+	mkdir(workDirectory, 0777);
+
+	char pathString[2000];
+	char source[2000];
+	sprintf(pathString, "%s/zipfCorpus", workDirectory);
+	sprintf(source, "%s/applications/benchmarks/zipfCorpus.c", sourceDirectory);
+	if(buildTool(source, pathString, TOOLDEFAULT, TOOLDEFAULT)) return 1;
+
+	//every tool, for every RIVSIZE and CACHESIZE, is built before anything is run
+	for(int r=0; r<rivSizeCount; r++){
+		sprintf(pathString, "%s/RIVcull_%d", workDirectory, rivSizes[r]);
+		sprintf(source, "%s/applications/RIVcull.c", sourceDirectory);
+		if(buildTool(source, pathString, rivSizes[r], TOOLDEFAULT)) return 1;
+		sprintf(pathString, "%s/DensityClustering_%d", workDirectory, rivSizes[r]);
+		sprintf(source, "%s/applications/DensityClustering.c", sourceDirectory);
+		if(buildTool(source, pathString, rivSizes[r], TOOLDEFAULT)) return 1;
+		for(int c=0; c<cacheSizeCount; c++){
+			sprintf(pathString, "%s/RIVread_%d_%d", workDirectory, rivSizes[r], cacheSizes[c]);
+			sprintf(source, "%s/applications/lexiconBuilder/RIVread.c", sourceDirectory);
+			if(buildTool(source, pathString, rivSizes[r], cacheSizes[c])) return 1;
+		}
+	}
+
+	printf("[");
+	char corpus[2000];
+	char lexicon[2000];
+	sprintf(lexicon, "%s/lexicon", workDirectory);
+	char logName[2000];
+	struct runStats stats;
+	for(int v=0; v<vocabularyCount; v++)
+	for(int d=0; d<documentCount; d++)
+	for(int l=0; l<lineCount; l++)
+	for(int w=0; w<lineWordCount; w++){
+		struct corpusShape shape = {.vocabulary = vocabularies[v], .documents = documents[d],
+			.lines = lines[l], .lineWords = lineWords[w]};
+		sprintf(corpus, "%s/corpus_%d_%d_%d_%d", workDirectory, shape.vocabulary, shape.documents, shape.lines, shape.lineWords);
+		if(makeCorpus(&shape, corpus, exponent)) return 1;
+
+		for(int r=0; r<rivSizeCount; r++){
+			for(int c=0; c<cacheSizeCount; c++){
+				removeDirectory(lexicon);
+				sprintf(pathString, "%s/RIVread_%d_%d", workDirectory, rivSizes[r], cacheSizes[c]);
+				sprintf(logName, "%s/RIVread.log", workDirectory);
+				char* readArgs[] = {pathString, corpus, lexicon, NULL};
+				runCommand(readArgs, logName, &stats);
+				printRun("RIVread", &shape, rivSizes[r], cacheSizes[c], &stats, shape.words, cacheHitRate(logName));
+			}
+			//the lexicon of the last build is clustered; neither tool has a cache
+			sprintf(pathString, "%s/DensityClustering_%d", workDirectory, rivSizes[r]);
+			sprintf(logName, "%s/DensityClustering.log", workDirectory);
+			char* clusterArgs[] = {pathString, lexicon, NULL};
+			runCommand(clusterArgs, logName, &stats);
+			printRun("DensityClustering", &shape, rivSizes[r], -1, &stats, 0, -1);
+
+			sprintf(pathString, "%s/RIVcull_%d", workDirectory, rivSizes[r]);
+			sprintf(logName, "%s/RIVcull.log", workDirectory);
+			char* cullArgs[] = {pathString, corpus, NULL};
+			runCommand(cullArgs, logName, &stats);
+			printRun("RIVcull", &shape, rivSizes[r], -1, &stats, shape.words, -1);
+		}
+	}
+	puts("\n]");
+	removeDirectory(lexicon);
+	return 0;
+}
+
+int parseList(char* text, int* list){
+	int count = 0;
+	char* item = strtok(text, ",");
+	while(item && count < MAXLIST){
+		list[count++] = atoi(item);
+		item = strtok(NULL, ",");
+	}
+	return count;
+}
+
+//runs a program to completion, with its output sent to logName, and measures it.
+//returns its exit status, or -1 if it could not be run
+int runCommand(char* const argv[], const char* logName, struct runStats* stats){
+	memset(stats, 0, sizeof(struct runStats));
+	double start = timeNow();
+	pid_t child = fork();
+	if(child == -1) return -1;
+	if(!child){
+		int log = open(logName, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+		if(log != -1){
+			dup2(log, STDOUT_FILENO);
+			dup2(log, STDERR_FILENO);
+			close(log);
+		}
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	//the child is waited for without being reaped, so that its I/O counts
+	//can still be read from /proc, then reaped for its resource usage
+	siginfo_t info;
+	waitid(P_PID, child, &info, WEXITED|WNOWAIT);
+	stats->seconds = timeNow()-start;
+	char procName[100];
+	sprintf(procName, "/proc/%d/io", child);
+	FILE* io = fopen(procName, "r");
+	if(io){
+		char line[200];
+		long long value;
+		while(fgets(line, sizeof(line), io)){
+			if(sscanf(line, "rchar: %lld", &value) == 1) stats->readBytes = value;
+			if(sscanf(line, "wchar: %lld", &value) == 1) stats->writeBytes = value;
+		}
+		fclose(io);
+	}
+	int status;
+	struct rusage usage;
+	wait4(child, &status, 0, &usage);
+	stats->status = WIFEXITED(status)? WEXITSTATUS(status): -1;
+	stats->userSeconds = usage.ru_utime.tv_sec+usage.ru_utime.tv_usec*1e-6;
+	stats->systemSeconds = usage.ru_stime.tv_sec+usage.ru_stime.tv_usec*1e-6;
+	stats->maxRSS = usage.ru_maxrss;
+	stats->blockReadBytes = usage.ru_inblock*512LL;
+	stats->blockWriteBytes = usage.ru_oublock*512LL;
+	return stats->status;
+}
+
+//a size of TOOLDEFAULT is left to the source's own default. a CACHESIZE of 0
+//is a real setting, which builds with no cache at all
+int buildTool(const char* source, const char* output, int rivSize, int cacheSize){
+	char* compiler = getenv("CC");
+	char include[2100];
+	char rivDefine[50];
+	char cacheDefine[50];
+	char logName[2100];
+	sprintf(include, "-I%s", sourceDirectory);
+	sprintf(rivDefine, "-DRIVSIZE=%d", rivSize);
+	sprintf(cacheDefine, "-DCACHESIZE=%d", cacheSize);
+	sprintf(logName, "%s.log", output);
+	char* buildArgs[12] = {compiler? compiler: "gcc", "-O2", include, (char*)source,
+		"-o", (char*)output, "-lm", "-pthread"};
+	int argCount = 8;
+	if(rivSize != TOOLDEFAULT) buildArgs[argCount++] = rivDefine;
+	if(cacheSize != TOOLDEFAULT) buildArgs[argCount++] = cacheDefine;
+	buildArgs[argCount] = NULL;
+	struct runStats stats;
+	if(runCommand(buildArgs, logName, &stats)){
+		fprintf(stderr, "failed to build %s, see %s\n", source, logName);
+		return 1;
+	}
+	return 0;
+}
+
+//generates a corpus, unless it was already generated by an earlier run.
+//its size is recorded beside it, for reuse
+int makeCorpus(struct corpusShape* shape, const char* directory, double exponent){
+	char summaryName[2100];
+	sprintf(summaryName, "%s.summary", directory);
+	FILE* summary = fopen(summaryName, "r");
+	if(summary){
+		int found = fscanf(summary, "words: %lld bytes: %lld", &shape->words, &shape->bytes);
+		fclose(summary);
+		if(found == 2) return 0;
+	}
+	char generator[2100];
+	char arguments[5][20];
+	sprintf(generator, "%s/zipfCorpus", workDirectory);
+	sprintf(arguments[0], "%d", shape->vocabulary);
+	sprintf(arguments[1], "%d", shape->documents);
+	sprintf(arguments[2], "%d", shape->lines);
+	sprintf(arguments[3], "%d", shape->lineWords);
+	sprintf(arguments[4], "%g", exponent);
+	char* generateArgs[] = {generator, (char*)directory, arguments[0], arguments[1],
+		arguments[2], arguments[3], arguments[4], NULL};
+	removeDirectory(directory);
+	struct runStats stats;
+	if(runCommand(generateArgs, summaryName, &stats)){
+		fprintf(stderr, "failed to generate %s\n", directory);
+		return 1;
+	}
+	return makeCorpus(shape, directory, exponent);
+}
+
+//removes a directory of files, such as a lexicon or corpus
+void removeDirectory(const char* name){
+	DIR* directory = opendir(name);
+	if(!directory) return;
+	struct dirent* files;
+	char pathString[2100];
+	while((files = readdir(directory))){
+		if(!strcmp(files->d_name, ".") || !strcmp(files->d_name, "..")) continue;
+		sprintf(pathString, "%s/%s", name, files->d_name);
+		unlink(pathString);
+	}
+	closedir(directory);
+	rmdir(name);
+}
+
+//the share of lexicon pulls answered by the cache, from the final stats RIVread
+//prints (see lexStatsPrint). -1 if there are none
+double cacheHitRate(const char* logName){
+	FILE* log = fopen(logName, "r");
+	if(!log) return -1;
+	char line[2000];
+	double rate = -1;
+	while(fgets(line, sizeof(line), log)){
+		char* pulls = strstr(line, "\"pulls\": ");
+		char* hits = strstr(line, "\"cacheHits\": ");
+		if(!pulls || !hits) continue;
+		double pullCount = atof(pulls+strlen("\"pulls\": "));
+		if(pullCount > 0){
+			rate = atof(hits+strlen("\"cacheHits\": "))/pullCount;
+		}
+	}
+	fclose(log);
+	return rate;
+}
+
+//units is what throughput is counted in (corpus words), 0 if it has none.
+//a cacheSize of -1 marks a tool with no cache, a hitRate of -1 one with no hit rate
+void printRun(const char* tool, struct corpusShape* shape, int rivSize, int cacheSize, struct runStats* stats, long long units, double hitRate){
+	printf("%s\n  {\"tool\": \"%s\", \"vocabulary\": %d, \"documents\": %d, \"lines\": %d, \"lineWords\": %d, ",
+		firstRun? "": ",", tool, shape->vocabulary, shape->documents, shape->lines, shape->lineWords);
+	printf("\"corpusWords\": %lld, \"corpusBytes\": %lld, \"RIVSIZE\": %d, ", shape->words, shape->bytes, rivSize);
+	if(cacheSize < 0){
+		printf("\"CACHESIZE\": null, ");
+	}else{
+		printf("\"CACHESIZE\": %d, ", cacheSize);
+	}
+	printf("\"status\": %d, \"seconds\": %.3f, \"userSeconds\": %.3f, \"systemSeconds\": %.3f, ",
+		stats->status, stats->seconds, stats->userSeconds, stats->systemSeconds);
+	if(units && stats->seconds > 0){
+		printf("\"wordsPerSecond\": %.0f, ", units/stats->seconds);
+	}else{
+		printf("\"wordsPerSecond\": null, ");
+	}
+	printf("\"maxRSSKB\": %ld, \"readBytes\": %lld, \"writeBytes\": %lld, \"blockReadBytes\": %lld, \"blockWriteBytes\": %lld, ",
+		stats->maxRSS, stats->readBytes, stats->writeBytes, stats->blockReadBytes, stats->blockWriteBytes);
+	if(hitRate < 0){
+		printf("\"cacheHitRate\": null}");
+	}else{
+		printf("\"cacheHitRate\": %.4f}", hitRate);
+	}
+	firstRun = 0;
+	fflush(stdout);
+}
+
+double timeNow(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec+now.tv_nsec*1e-9;
+}
@@ -0,0 +1,31 @@
+#!/bin/sh
+# builds RIVbench once for each RIVSIZE and runs it, printing a JSON array
+# with one object per size.  any arguments are passed on to RIVbench (nnz values)
+# usage: ./benchSweep.sh [nnz ...] > results.json
+# RIVSIZES and NONZEROS may be set in the environment, CC and CFLAGS too
+
+cd "$(dirname "$0")"
+RIVSIZES=${RIVSIZES:-"10000 25000 60000 100000"}
+NONZEROS=${NONZEROS:-2}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:-"-O2"}
+
+echo "["
+first=1
+for size in $RIVSIZES; do
+	binary=./RIVbench_$size
+	if ! $CC $CFLAGS -DRIVSIZE=$size -DNONZEROS=$NONZEROS RIVbench.c -o $binary -lm -pthread; then
+		echo "build failed for RIVSIZE $size" >&2
+		exit 1
+	fi
+	# sizes beyond this RIVSIZE are dropped, rather than rejected
+	args=""
+	for nnz in "$@"; do
+		[ "$nnz" -le "$size" ] && args="$args $nnz"
+	done
+	[ $first = 1 ] || echo ","
+	first=0
+	$binary $args
+	rm -f $binary
+done
+echo "]"
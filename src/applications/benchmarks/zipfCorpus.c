@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/stat.h>
+
+//this program writes a synthetic corpus, a directory of text files whose words
+//are drawn from a vocabulary with Zipf distributed frequencies, as natural text
+//is.  the same arguments always produce the same corpus, so that
+//scaling runs can be repeated and compared
+//usage: ./zipfCorpus <directory> <vocabulary> <documents> <linesPerDocument> <wordsPerLine> [exponent] [seed]
+//line and document lengths vary uniformly between half and one and a half times
+//the given averages. when finished, prints the words and bytes written
+
+struct zipfState{
+	uint64_t random;
+	//the cumulative probability of each rank, for sampling
+	double* cumulative;
+	char** words;
+	int vocabulary;
+};
+
+uint64_t nextRandom(struct zipfState* state);
+int randomBelow(struct zipfState* state, int limit);
+void makeVocabulary(struct zipfState* state, double exponent);
+int sampleRank(struct zipfState* state);
+int varied(struct zipfState* state, int average);
+
+int main(int argc, char *argv[]){
+	if(argc < 6){
+		puts("correct usage:");
+		puts("./zipfCorpus <directory> <vocabulary> <documents> <linesPerDocument> <wordsPerLine> [exponent] [seed]");
+		return 1;
+	}
+	struct zipfState state = {0};
+	state.vocabulary = atoi(argv[2]);
+	int documents = atoi(argv[3]);
+	int lines = atoi(argv[4]);
+	int lineWords = atoi(argv[5]);
+	double exponent = argc > 6? atof(argv[6]): 1.0;
+	state.random = argc > 7? strtoull(argv[7], NULL, 10): 1;
+	if(state.vocabulary < 1 || documents < 1 || lines < 1 || lineWords < 1){
+		puts("vocabulary, documents, lines and words must all be positive");
+		return 1;
+	}
+	//a zero state would stay zero
+	if(!state.random) state.random = 1;
+
+	struct stat st = {0};
+	if(stat(argv[1], &st) == -1){
+		mkdir(argv[1], 0777);
+	}
+	makeVocabulary(&state, exponent);
+
+	char pathString[1000];
+	size_t totalWords = 0;
+	size_t totalBytes = 0;
+	for(int i=0; i<documents; i++){
+		sprintf(pathString, "%s/doc%06d.txt", argv[1], i);
+		FILE* document = fopen(pathString, "w");
+		if(!document){
+			printf("could not write %s\n", pathString);
+			return 1;
+		}
+		int lineCount = varied(&state, lines);
+		for(int j=0; j<lineCount; j++){
+			int wordCount = varied(&state, lineWords);
+			for(int k=0; k<wordCount; k++){
+				char* word = state.words[sampleRank(&state)];
+				totalBytes += fprintf(document, k? " %s": "%s", word);
+			}
+			fputc('\n', document);
+			totalBytes++;
+			totalWords += wordCount;
+		}
+		fclose(document);
+	}
+	printf("words: %zu bytes: %zu\n", totalWords, totalBytes);
+	return 0;
+}
+
+//xorshift64*, so that the corpus does not depend on the C library's rand()
+uint64_t nextRandom(struct zipfState* state){
+	state->random ^= state->random >> 12;
+	state->random ^= state->random << 25;
+	state->random ^= state->random >> 27;
+	return state->random * 2685821657736338717ULL;
+}
+int randomBelow(struct zipfState* state, int limit){
+	return (nextRandom(state)>>11) % limit;
+}
+int varied(struct zipfState* state, int average){
+	int low = average/2;
+	if(low < 1) low = 1;
+	return low+randomBelow(state, average+1);
+}
+
+void makeVocabulary(struct zipfState* state, double exponent){
+	state->cumulative = malloc(state->vocabulary*sizeof(double));
+	state->words = malloc(state->vocabulary*sizeof(char*));
+	double sum = 0;
+	for(int rank=0; rank<state->vocabulary; rank++){
+		sum += 1/pow(rank+1, exponent);
+		state->cumulative[rank] = sum;
+	}
+	for(int rank=0; rank<state->vocabulary; rank++){
+		state->cumulative[rank] /= sum;
+	}
+	//each word is a few random letters, followed by its rank in base 26, in as
+	//many digits as the largest rank needs.  as every word ends in the same
+	//number of digits, no two ranks can give the same word, whatever letters
+	//come before. common words have fewer letters, as they do in real text
+	int digits = 1;
+	for(int number=state->vocabulary-1; number >= 26; number /= 26){
+		digits++;
+	}
+	for(int rank=0; rank<state->vocabulary; rank++){
+		char word[40];
+		int length = 2+randomBelow(state, 2+rank*6/state->vocabulary);
+		for(int i=0; i<length; i++){
+			word[i] = 'a'+randomBelow(state, 26);
+		}
+		int number = rank;
+		for(int i=0; i<digits; i++){
+			word[length++] = 'a'+number%26;
+			number /= 26;
+		}
+		word[length] = 0;
+		state->words[rank] = strdup(word);
+	}
+}
+
+int sampleRank(struct zipfState* state){
+	double target = (nextRandom(state)>>11) * (1.0/9007199254740992.0);
+	//the first rank whose cumulative probability passes the target
+	int low = 0;
+	int high = state->vocabulary-1;
+	while(low < high){
+		int middle = (low+high)/2;
+		if(state->cumulative[middle] < target){
+			low = middle+1;
+		}else{
+			high = middle;
+		}
+	}
+	return low;
+}
@@ -6,34 +6,88 @@
 #include <dirent.h>
 #include <error.h>
 #include <string.h>
+#include <time.h>
 
+//RIVSIZE and CACHESIZE may be overridden when compiling (-DRIVSIZE=...), as the scaling harness does
+#ifndef RIVSIZE
 #define RIVSIZE 60000
+#endif
 #define NONZEROS 2
+#ifndef CACHESIZE
 #define CACHESIZE 35000
+#endif
 #define SORTCACHE
+#define WRITERCOUNT 2
+//LEXPOOL takes pulled vectors from a pool of buffers; every vector here is pushed
+#define LEXPOOL 1
+//LOOKAHEAD lines are read and cleaned ahead of the one being processed, and the
+//lexicon files of their words read in the background meanwhile. 0 reads nothing ahead
+#ifndef LOOKAHEAD
+#define LOOKAHEAD 16
+#endif
 #include "RIVtools.h"
 //this program reads a directory full of files, and adds all context vectors (considering sentence as context)
 //to all words found in these files. this is used to create a lexicon, or add to an existing one
+//built with -DRIVTRACE=1, the time spent in each stage is traced, and written on exit as a
+//Chrome trace to $RIVTRACEFILE (or RIVread.trace.json). $RIVTRACESAMPLE=N traces one line in N
 
-void fileGrind(FILE* textFile);
+void fileGrind(RIVinput* textFile);
 void addContext(denseRIV* lexRIV, sparseRIV* context);
 void directoryGrind(char *rootString);
-void lineGrind(char* textLine);
+void lineGrind(RIVwords* words);
+void statsTick();
+void traceFinish();
 
 LEXICON* lp;
 RIVtree* searchRoot = NULL;
+//the lines read ahead, and the one being processed. each is reused for line after
+//line, so that cleaning allocates only as lines grow
+struct aheadLine{
+	RIVbuffer buffer;
+	RIVwords words;
+};
+struct aheadLine aheadLines[LOOKAHEAD+1];
+//the vectors of each line's words, grown as needed
+denseRIV** lineRIVs = NULL;
+int lineRIVCapacity = 0;
+//if set, the lexicon's stats are printed to stderr every statsInterval seconds
+int statsInterval = 0;
+time_t lastStats;
 
 int main(int argc, char *argv[]){
 	if(argc < 3){
 		puts("correct usage:");
-		puts("./RIVread <directoryOfTextFiles> <LexiconToCreateOrAddTo>");
+		puts("./RIVread <directoryOfTextFiles> <LexiconToCreateOrAddTo> [statsSeconds]");
+		puts("a directory of \"-\" reads a single corpus from stdin");
+		puts("given statsSeconds, the lexicon's stats are printed to stderr that often");
+		return 1;
+	}
+	if(argc > 3){
+		statsInterval = atoi(argv[3]);
 	}
+	lastStats = time(NULL);
 	
 	searchRoot = stemTreeSetup(NULL);
 	
 	
 	lp = lexOpen(argv[2], "rw");
 	//we open the lexicon, if it does not yet exist, it will be created
+	//(unless it exists but was built with other settings)
+	if(!lp){
+		return 1;
+	}
+	//and its final stats, once closed, are printed with the rest of our output
+	lexStatsReport(lp, stdout);
+	
+	//a corpus may also be piped in, rather than read from files
+	if(!strcmp(argv[1], "-")){
+		RIVinput* input = inputOpen("-");
+		fileGrind(input);
+		inputClose(input);
+		lexClose(lp);
+		traceFinish();
+		return 0;
+	}
 	
 	char pathString[1000];
 	//we format the root directory, preparing to scan its contents
@@ -50,6 +104,7 @@ int main(int argc, char *argv[]){
 
 	//we close the lexicon again, ensuring all data is secured
 	lexClose(lp);
+	traceFinish();
 	return 0;
 }
 
@@ -79,75 +134,127 @@ void directoryGrind(char *rootString){
 		
 		//puts(files->d_name);
 		//open a file within root directory
-		FILE *input = fopen(pathString, "r");
+		RIVinput *input = inputOpen(pathString);
 		if(input){
 			
 			fileGrind(input);
 			
-			fclose(input);
+			inputClose(input);
 		}
 	}
 	closedir(directory);
 }
 
-void fileGrind(FILE* textFile){
-	char textLine[10000];
-	/* one line is taken as one "piece of context" */
+void fileGrind(RIVinput* textFile){
+	/* one line is taken as one "piece of context", however long it is */
+	const char* textLine;
+	size_t lineLength;
+	//the window of lines: the oldest, being processed, and how many are held
+	int oldest = 0;
+	int held = 0;
+	int ended = 0;
 	
-	while(fgets(textLine, 9999, textFile)){
+	while(1){
+		//the window is kept full, so that each line's files are read while
+		//the lines before it are processed
+		while(!ended && held <= LOOKAHEAD){
+			TRACESTART(readSpan, "readLine");
+			lineLength = inputNextLine(textFile, &textLine);
+			TRACESTOP(readSpan);
+			if(!lineLength){
+				ended = 1;
+				break;
+			}
+			struct aheadLine* line = aheadLines+(oldest+held)%(LOOKAHEAD+1);
+			
+			/*pre-clean the line to be processed, straight into a list of stems */ 
+			TRACESTART(cleanSpan, "cleanToWords");
+			int wordCount = cleanToWords(searchRoot, textLine, lineLength, &line->buffer, &line->words);
+			TRACESTOP(cleanSpan);
+			if(wordCount < CLEANMINWORDS) continue;
+			#if LOOKAHEAD > 0
+			TRACESTART(prefetchSpan, "lexPrefetch");
+			lexPrefetch(lp, line->words.list, line->words.count);
+			TRACESTOP(prefetchSpan);
+			#endif /* LOOKAHEAD > 0 */
+			held++;
+		}
+		if(!held) break;
 		
-		if(!strlen(textLine)) continue;
-		if(feof(textFile)) break;
-		/*pre-clean the line to be processed */ 
-		if(!cleanLine(searchRoot, textLine)) continue;
 		//process each line as a context set
-		lineGrind(textLine);
+		TRACESTART(lineSpan, "line");
+		lineGrind(&aheadLines[oldest].words);
+		TRACESTOP(lineSpan);
+		oldest = (oldest+1)%(LOOKAHEAD+1);
+		held--;
+		statsTick();
+	}
+}
+void traceFinish(){
+	#if RIVTRACE
+	char* traceFile = getenv("RIVTRACEFILE");
+	if(!traceFile) traceFile = "RIVread.trace.json";
+	if(traceWrite(traceFile)){
+		fprintf(stderr, "could not write the trace to %s\n", traceFile);
+	}
+	#endif /* RIVTRACE */
+}
+void statsTick(){
+	if(!statsInterval) return;
+	time_t now = time(NULL);
+	if(now-lastStats >= statsInterval){
+		lexStatsPrint(lp, stderr);
+		lastStats = now;
 	}
 }
 //form context vector from contents of text, then add that vector to
 //all lexicon entries of the words contained
-void lineGrind(char* textLine){
+void lineGrind(RIVwords* words){
 	//extract a context vector from this text set
-	sparseRIV* contextVector = textToL2(textLine);
+	TRACESTART(vectorSpan, "wordsToL2");
+	sparseRIV* contextVector = wordsToL2(words->list, words->count);
+	TRACESTOP(vectorSpan);
 	if(contextVector->contextSize <= 1){
 		free(contextVector);
 		return;
 	}
 		
+	if(words->count > lineRIVCapacity){
+		lineRIVCapacity = words->count*2;
+		lineRIVs = realloc(lineRIVs, lineRIVCapacity*sizeof(denseRIV*));
+	}
+	//we pull the vectors corresponding to all of the words from the lexicon at once
+	//if it's a new word, it is given a 0 vector. a repeated word shares one vector
+	TRACESTART(pullSpan, "lexPullMany");
+	lexPullMany(lp, words->list, words->count, lineRIVs);
+	TRACESTOP(pullSpan);
+	
 	denseRIV* lexiconRIV;
-	//identify stopping point in line read
-	char* textEnd = textLine + strlen(textLine)-1;
-	int displacement = 0;
-	char word[100] = {0};
-	while(textLine<textEnd){
-		sscanf(textLine, "%99s%n", word, &displacement);
-		//we ensure that each word exists, and is free of unwanted characters
-		
-		textLine += displacement+1;
+	for(int i=0; i<words->count; i++){
 		
-		
-		
-		//we pull the vector corresponding to each word from the lexicon
-		//if it's a new word, lexPull returns a 0 vector
-		lexiconRIV= lexPull(lp, word);
+		lexiconRIV = lineRIVs[i];
 		if(!lexiconRIV){
 			continue;
 		}
 		
 		//we add the context of this file to this wordVector
+		TRACESTART(addSpan, "addContext");
 		addContext(lexiconRIV, contextVector);
+		TRACESTOP(addSpan);
 		
 		//we remove the sub-vector corresponding to the word itself
+		TRACESTART(subtractSpan, "subtractThisWord");
 		subtractThisWord(lexiconRIV);
+		TRACESTOP(subtractSpan);
 		
 		//we log that this word has been encountered one more time
 		lexiconRIV->frequency += 1;
 		
-		//and finally we push it back to the lexicon for permanent storage
-		lexPush(lp, lexiconRIV);
-		
-		
 	}
+	//and finally we push them all back to the lexicon for permanent storage
+	TRACESTART(pushSpan, "lexPushMany");
+	lexPushMany(lp, lineRIVs, words->count);
+	TRACESTOP(pushSpan);
 	//free the heap allocated context vector data
 	free(contextVector);
 }
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//RIVSIZE macro must be set to the size of the RIVs in the lexicon
+#define RIVSIZE 60000
+#define NONZEROS 2
+#define CACHESIZE 0
+#include "../../RIVtools.h"
+
+//this program rewrites a lexicon in one pass: every vector in whichever form,
+//sparse or dense, is now the lighter (a word once saturated and since diluted
+//need not stay dense), words too rare to be of use dropped, and the rest
+//optionally scaled to one magnitude.  with no lexicon to create, the lexicon
+//is compacted in place
+
+int main(int argc, char *argv[]){
+	struct compactOptions options = {0};
+	//0 threads: one for each processor
+	int threadCount = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "f:c:m:t:")) != -1){
+		switch(opt){
+			case 'f': options.minFrequency = atoi(optarg); break;
+			case 'c': options.minContextSize = atoi(optarg); break;
+			case 'm': options.magnitude = atof(optarg); break;
+			case 't': threadCount = atoi(optarg); break;
+			default: argc = 0;
+		}
+	}
+	if(argc - optind < 1 || argc - optind > 2){
+		puts("correct usage:");
+		puts("./RIVcompact [-f minFrequency] [-c minContextSize] [-m magnitude] [-t threads] <Lexicon> [<LexiconToCreate>]");
+		puts("words seen fewer than minFrequency times, or in fewer than minContextSize contexts, are dropped");
+		puts("with -m, every vector kept is scaled to that magnitude, of at least 1");
+		return 1;
+	}
+	if(options.magnitude > 0 && options.magnitude < 1){
+		//no vector of integers is shorter than 1
+		puts("the magnitude must be at least 1");
+		return 1;
+	}
+	char* inName = argv[optind];
+	char* outName = argc - optind > 1? argv[optind+1]: inName;
+
+	struct compactStats stats;
+	int failures = lexCompact(outName, inName, &options, threadCount, &stats);
+	if(failures < 0){
+		puts("the lexicon could not be compacted");
+		return 1;
+	}
+	printf("%d words kept (%d dense), %d dropped, %llu bytes of vectors now %llu\n",
+		stats.kept, stats.dense, stats.dropped, stats.bytesRead, stats.bytesWritten);
+	if(failures){
+		//in place, such words are left as they were
+		printf("%d words could not be read or rescaled\n", failures);
+		return 1;
+	}
+	return 0;
+}
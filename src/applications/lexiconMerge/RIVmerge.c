@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//RIVSIZE macro must be set to the size of the RIVs in the lexica
+#define RIVSIZE 60000
+#define NONZEROS 2
+#define CACHESIZE 0
+#include "../../RIVtools.h"
+
+//this program merges lexica that were built separately, each over one part of a
+//corpus, into a single lexicon equal to a build over the whole corpus.
+//a large build can be split into shards, each read by its own RIVread, then reduced here
+
+int main(int argc, char *argv[]){
+	if(argc < 3){
+		puts("correct usage:");
+		puts("./RIVmerge <LexiconToCreate> <Lexicon> [<Lexicon> ...]");
+		return 1;
+	}
+	
+	//0 threads: one for each processor
+	int failures = lexMerge(argv[1], argv+2, argc-2, 0);
+	if(failures < 0){
+		puts("the lexica could not be merged");
+		return 1;
+	}
+	if(failures){
+		printf("%d words failed to merge\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//RIVSIZE macro must be set to the size of the RIVs in the lexicon
+#ifndef RIVSIZE
+#define RIVSIZE 60000
+#endif
+#define NONZEROS 2
+#define CACHESIZE 0
+#include "../../RIVtools.h"
+
+//this program turns every line of a corpus into a document vector, the sum of the
+//lexicon vectors of its words, using every processor. the lexicon is only read.
+//the vectors are written, in the order of the lines, to a collection file (see RIVcollection.h)
+
+int main(int argc, char *argv[]){
+	//with -n, a line beginning with a name and a tab is named by it
+	int named = 0;
+	if(argc > 1 && !strcmp(argv[1], "-n")){
+		named = 1;
+		argc--;
+		argv++;
+	}
+	if(argc < 4){
+		puts("correct usage:");
+		puts("./RIVvectorize [-n] <Lexicon> <corpusFile> <collectionToCreate> [threads]");
+		puts("a corpusFile of \"-\" reads the corpus from stdin, one document per line");
+		puts("with -n, a line of \"name<tab>text\" is named by its name, rather than its line number");
+		return 1;
+	}
+	//0 threads: one for each processor
+	int threadCount = argc > 4? atoi(argv[4]): 0;
+	
+	struct timespec begin, loaded, end;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	lexView* view = lexViewOpen(argv[1], threadCount);
+	if(!view){
+		printf("the lexicon %s could not be read\n", argv[1]);
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &loaded);
+	
+	RIVinput* input = inputOpen(argv[2]);
+	if(!input){
+		printf("corpus not found, %s\n", argv[2]);
+		lexViewClose(view);
+		return 1;
+	}
+	RIVcollectionWriter* output = collectionCreate(argv[3]);
+	if(!output){
+		printf("could not create %s\n", argv[3]);
+		inputClose(input);
+		lexViewClose(view);
+		return 1;
+	}
+	RIVtree* stemRoot = stemTreeSetup(NULL);
+	
+	long documents = vectorizeStream(view, stemRoot, input, output, threadCount, named);
+	int failed = collectionFinish(output) || documents < 0;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	double loadSeconds = (loaded.tv_sec-begin.tv_sec)+(loaded.tv_nsec-begin.tv_nsec)/1e9;
+	double seconds = (end.tv_sec-loaded.tv_sec)+(end.tv_nsec-loaded.tv_nsec)/1e9;
+	fprintf(stderr, "%d words loaded in %.2fs", view->count, loadSeconds);
+	if(view->failures){
+		fprintf(stderr, " (%d could not be read)", view->failures);
+	}
+	fprintf(stderr, ", %ld documents vectorized in %.2fs (%.0f/s)\n",
+		documents, seconds, seconds > 0? documents/seconds: 0);
+	
+	inputClose(input);
+	destroyTree(stemRoot);
+	lexViewClose(view);
+	if(failed){
+		printf("could not write %s\n", argv[3]);
+		return 1;
+	}
+	return 0;
+}
@@ -3,61 +3,223 @@
 
 
 #include "stemconfig/stemset.h"
+#include "RIVtokenizer.h"
+#include "RIVstemmer.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#define ALPHAFILTER 31
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-typedef struct RIVtreenode{
+/* the RIVtree maps words to data. it is kept under its old name and
+ * interface, but is no longer a tree: it is a flat open-addressed hash
+ * table in the style of a swiss table.  each slot has one control byte,
+ * holding 7 bits of its word's hash, and control bytes are searched 16 at
+ * a time, so that a lookup usually costs one hash, one group of control
+ * bytes, and one string comparison, with no pointer chasing.
+ * a zeroed RIVtree is a valid, empty map
+ */
+struct RIVtreeSlot{
+	const char* word;
 	void* data;
-	struct RIVtreenode* links[32];
-	int downstream;
-	
+	uint32_t hash;
+	/* whether the map owns (must free) the word, or only borrows it */
+	uint32_t owned;
+};
+typedef struct RIVtree{
+	unsigned char* control;
+	struct RIVtreeSlot* slots;
+	/* always a power of two, and a multiple of the group size */
+	size_t capacity;
+	size_t count;
+	size_t deleted;
+	/* a block of words which borrowed entries point into, freed with the tree */
+	char* keyBlock;
+	/* a tree mapped from a stem table file (see stemTableOpen) has its
+	 * control bytes, slots and strings in the mapping, and is read only */
+	const char* table;
+	size_t tableLength;
+	const struct RIVtableSlot* tableSlots;
+	const char* tableStrings;
+	/* whether this is a complete stem tree, whose missing words are given
+	 * to the fallback stemmer (see RIVstemmer.h) */
+	int fallback;
 }RIVtree;
-RIVtree *nextNode;
 
-/* treeInsert, with a memory save for a tree of known size */
+/* a stem table is a RIVtree written to a file, exactly as it is laid out
+ * in memory, except that pointers are replaced by offsets into a block of
+ * strings. it can be mapped and searched in place with no parsing at all,
+ * and its pages are shared by every process which maps it.
+ * the file is: a RIVtableHeader, "capacity" control bytes, "capacity"
+ * RIVtableSlots, then the strings. it is in the byte order of the machine
+ * that wrote it
+ */
+struct RIVtableSlot{
+	uint32_t word;
+	uint32_t data;
+	uint32_t hash;
+	uint32_t unused;
+};
+struct RIVtableHeader{
+	char magic[8];
+	/* STEMTABLEVERSION, changed whenever the layout or treeHash changes */
+	uint32_t version;
+	uint32_t groupSize;
+	uint64_t capacity;
+	uint64_t count;
+	uint64_t stringsLength;
+	uint64_t reserved[3];
+};
+#define STEMTABLEMAGIC "RIVSTEM"
+#define STEMTABLEVERSION 1
+
+/* control byte values, anything else is the low 7 bits of a full slot's hash */
+#define TREEEMPTY 0x80
+#define TREEDELETED 0xFE
+#define TREEGROUP 16
+
+/* creates an empty map with room for "expected" words before it must grow */
+RIVtree* treeCreate(size_t expected);
+
+/* treeInsert, for a word which will outlive the tree (for instance, one in
+ * its keyBlock), and need not be copied */
 void stemInsert(RIVtree* tree, char* word, void* data);
 
-/* removes one element of a tree, along with any now dead trailing branches */
+/* removes one element of a tree. returns 1 if it was present */
 int treecut(RIVtree* tree, char* word);
 
-/* inserts one entry into the word tree, creating a path to itself as necessary */
+/* inserts one entry into the word tree, keeping its own copy of the word.
+ * a word already present keeps the data it was first given */
 void treeInsert(RIVtree* tree, char* word, void* data);
 
 /* retrieves a piece of data corresponding to one word */ 
 void* treeSearch(RIVtree* tree, char* word);
 
+/* the hash of a word, by which its slot is found */
+uint32_t treeHash(const char* word);
+
+/* finds the slot holding "word", or the slot it should be placed in.
+ * returns 1 if found, 0 if not */
+int treeProbe(RIVtree* tree, const char* word, uint32_t hash, size_t* slot);
+
+/* rebuilds the table with room for at least "expected" words */
+void treeResize(RIVtree* tree, size_t expected);
+
+/* the shared body of treeInsert and stemInsert */
+void treePlace(RIVtree* tree, char* word, void* data, int owned);
+
 /* builds a stemtree, accepts an argument:
 NULL to indicate a complete and exhaustive tree
 non-null, should be a list of stems to include in the tree
+a complete tree is mapped from the stem table named by the environment
+variable RIVSTEMTABLE, or else by STEMTABLE if it is defined at compile
+time, falling back to building from the stemset literals if there is none
 */
 RIVtree* stemTreeSetup(char*);
 
+/* stemTreeSetup, always building from the stemset literals, and never
+ * mapping a stem table */
+RIVtree* stemTreeBuild(char* selectionFile);
+
+/* writes a tree, whose data are all strings, as a stem table.  a tree
+ * mapped from a table is not written.  returns 0 on success */
+int stemTableWrite(RIVtree* tree, const char* fileName);
+
+/* maps a stem table as a read only tree. returns NULL if the file is
+ * missing or is not a valid table for this build.  every slot is checked
+ * against the size of the file before the table is trusted */
+RIVtree* stemTableOpen(const char* fileName);
+
 /* used temporarily by the stemtree to optimize shrunken tree creation */
 RIVtree* dummyTree(char*);
 
 void destroyTree(RIVtree* tree);
 
+/* CLEANMINWORDS is the fewest words a cleaned line may hold and still be
+ * worth using as a context */
+#ifndef CLEANMINWORDS
+#define CLEANMINWORDS 5
+#endif
+
+/* a growable block of text, for output of unknown length. a zeroed
+ * RIVbuffer is empty and ready to use */
+typedef struct RIVbuffer{
+	char* text;
+	size_t length;
+	size_t capacity;
+}RIVbuffer;
+
+/* the words of a cleaned text, each a null terminated string held in the
+ * RIVbuffer they were cleaned into.  a zeroed RIVwords is ready to use */
+typedef struct RIVwords{
+	char** list;
+	int count;
+	int capacity;
+}RIVwords;
+
+/* ensures room for "extra" more characters in the buffer */
+void bufferReserve(RIVbuffer* buffer, size_t extra);
+
+void bufferFree(RIVbuffer* buffer);
+
+/* cleans, and stems (if searchRoot is non-NULL) a single word given as a
+ * span, into "word" (TOKENSIZE chars).  returns the stem, which may be
+ * "word" itself, or NULL if nothing remains. a word missing from a complete
+ * stem tree is stemmed into "word" by the fallback stemmer, and one missing
+ * from a tree of selected stems (or with STEMFALLBACK 0) has no stem, and
+ * returns NULL */
+char* stemToken(RIVtree* searchRoot, const char* token, size_t length, char* word);
+
+/* cleanLine cleans and stems a line of text in place, leaving each stem
+ * followed by a space.  returns the new length of the line, or 0 if fewer
+ * than CLEANMINWORDS words remain. in the rare case that stems outgrow the
+ * line, the line is truncated, as it has no room to grow
+ */
+int cleanLine(RIVtree* searchRoot, char* textLine);
+
+/* cleanText cleans and stems "length" characters of text, appending each
+ * stem, followed by "separator", to the output buffer, which grows as
+ * needed. it runs in time linear to the text, whatever its length.
+ * returns the number of words written */
+int cleanText(RIVtree* searchRoot, const char* text, size_t length, RIVbuffer* output, char separator);
+
+/* cleanToWords does the same, but rather than text to be tokenized again,
+ * it emits the list of stems directly: each is null terminated within
+ * "output" (which is emptied first), and listed in order in "words" */
+int cleanToWords(RIVtree* searchRoot, const char* text, size_t length, RIVbuffer* output, RIVwords* words);
+
 /* creates a standard seed from the characters in a word, hopefully unique */
 int wordtoSeed(char* word);
 
+/* the same seed, from a word given as a span of text */
+int spanToSeed(const char* word, size_t length);
+
 
 int wordtoSeed(char* word){
-	int i=0;
-	int seed = 0;
-	while(*word){
+	return spanToSeed(word, strlen(word));
+}
+int spanToSeed(const char* word, size_t length){
+	/* summed unsigned, so that overflow wraps (as it always has) rather than
+	 * being undefined */
+	unsigned int seed = 0;
+	for(size_t i=0; i<length; i++){
 		/* left-shift 5 each time *should* make seeds unique to words
 		 * this means letters are taken as characters counted in base 32, which
-		 * should be large enough to hold all english characters plus a few outliers
+		 * should be large enough to hold all english characters plus a few outliers.
+		 * the shift wraps at 32 bits, as x86 always has, so that seeds (and so
+		 * every barcode in existing lexica) are unchanged
 		 * */
-		seed += (*(word))<<(i*5);
-		word++;
-		i++;
+		seed += (unsigned int)word[i]<<((i*5)&31);
 	}
-	return seed;
+	return (int)seed;
 }
 int clean(char* word){
 	
@@ -78,67 +240,173 @@ int clean(char* word){
 	if(outLetter == word) return 0;
 	else return 1;
 }
+void bufferReserve(RIVbuffer* buffer, size_t extra){
+	if(buffer->length+extra+1 <= buffer->capacity) return;
+	/* doubling keeps appends linear overall */
+	size_t capacity = buffer->capacity? buffer->capacity*2: 1024;
+	while(capacity < buffer->length+extra+1){
+		capacity *= 2;
+	}
+	buffer->text = realloc(buffer->text, capacity);
+	buffer->capacity = capacity;
+}
+void bufferFree(RIVbuffer* buffer){
+	free(buffer->text);
+	buffer->text = NULL;
+	buffer->length = 0;
+	buffer->capacity = 0;
+}
+char* stemToken(RIVtree* searchRoot, const char* token, size_t length, char* word){
+	size_t cleanLength = cleanToken(token, length, word);
+	if(!cleanLength) return NULL;
+	
+	if(searchRoot){
+		char* stem = treeSearch(searchRoot, word);
+		#if STEMFALLBACK
+		if(!stem && searchRoot->fallback){
+			stem = fallbackStem(word, cleanLength);
+		}
+		#endif /* STEMFALLBACK */
+		return stem;
+	}
+	return word;
+}
 int cleanLine(RIVtree* searchRoot, char* textLine){
 	int wordCount = 0;
-	char word[199];
-	int displacement;
+	char word[TOKENSIZE];
 	char* stem;
-	char temp[100000] = {0};
-	char* textBase = textLine;
-	char* textEnd = textLine + strlen(textLine);
-	while(textLine<textEnd){
-		
-		displacement=0;
-		sscanf(textLine, "%99s%n", word, &displacement);
-		
-		textLine += displacement +1;
-		if(!displacement)continue;
-		
-		if(!clean(word))continue;
+	/* stems are written back over the line behind the tokenizer, which is
+	 * always at or ahead of the write point */
+	char* write = textLine;
+	char* textEnd = textLine+strlen(textLine);
+	const char* token;
+	size_t length;
+	RIVtokenizer tokens;
+	tokenizerInit(&tokens, textLine, textEnd-textLine);
+	while((length = nextToken(&tokens, &token))){
 		
-	
+		/* words with no stem are dropped */
+		if(!(stem = stemToken(searchRoot, token, length, word))) continue;
 		
-		if(searchRoot){
-			stem = treeSearch(searchRoot, word);
+		size_t stemLength = strlen(stem);
+		/* the stem and its space must land on what has already been read:
+		 * before the end of this word, or on the whitespace that follows it */
+		char* wordEnd = (char*)tokens.cursor;
+		if(write+stemLength >= wordEnd && !(write+stemLength == wordEnd && wordEnd < textEnd)){
+			/* the stems have outgrown the line. finish the rest in a buffer,
+			 * and keep as much as the line has room for */
+			RIVbuffer overflow = {0};
+			bufferReserve(&overflow, stemLength+1);
+			memcpy(overflow.text, stem, stemLength);
+			overflow.text[stemLength] = ' ';
+			overflow.length = stemLength+1;
+			wordCount++;
+			wordCount += cleanText(searchRoot, tokens.cursor, textEnd-tokens.cursor, &overflow, ' ');
 			
-		}else{
-			stem = word;
-		}
-		if(!stem){
-			textBase[0] = 0;
-			continue;
+			size_t room = textEnd-write;
+			if(overflow.length < room) room = overflow.length;
+			memcpy(write, overflow.text, room);
+			write += room;
+			bufferFree(&overflow);
+			break;
 		}
+		memmove(write, stem, stemLength);
+		write += stemLength;
+		*(write++) = ' ';
 		wordCount++;
-		strcat(temp, stem);
-		strcat(temp, " ");
-		
 	}
+	*write = 0;
 	
-	if(wordCount < 5){
+	if(wordCount < CLEANMINWORDS){
 		return 0;
 	}
-	strcpy(textBase, temp);
-	return strlen(textBase);
+	return write-textLine;
+}
+int cleanText(RIVtree* searchRoot, const char* text, size_t length, RIVbuffer* output, char separator){
+	int wordCount = 0;
+	char word[TOKENSIZE];
+	char* stem;
+	const char* token;
+	size_t tokenLength;
+	RIVtokenizer tokens;
+	tokenizerInit(&tokens, text, length);
+	while((tokenLength = nextToken(&tokens, &token))){
+		
+		if(!(stem = stemToken(searchRoot, token, tokenLength, word))) continue;
+		
+		size_t stemLength = strlen(stem);
+		bufferReserve(output, stemLength+1);
+		memcpy(output->text+output->length, stem, stemLength);
+		output->length += stemLength;
+		output->text[output->length++] = separator;
+		wordCount++;
+	}
+	if(output->text){
+		output->text[output->length] = 0;
+	}
+	return wordCount;
+}
+int cleanToWords(RIVtree* searchRoot, const char* text, size_t length, RIVbuffer* output, RIVwords* words){
+	output->length = 0;
+	int wordCount = cleanText(searchRoot, text, length, output, '\0');
+	
+	if(wordCount > words->capacity){
+		words->capacity = wordCount*2;
+		words->list = realloc(words->list, words->capacity*sizeof(char*));
+	}
+	/* the buffer is now final, so pointers into it will stay valid */
+	char* word = output->text;
+	for(int i=0; i<wordCount; i++){
+		words->list[i] = word;
+		word += strlen(word)+1;
+	}
+	words->count = wordCount;
+	return wordCount;
 }
 
 
 RIVtree* stemTreeSetup(char* selectionFile){
+	if(!selectionFile){
+		const char* tableName = getenv("RIVSTEMTABLE");
+		#ifdef STEMTABLE
+		if(!tableName) tableName = STEMTABLE;
+		#endif /* STEMTABLE */
+		if(tableName){
+			RIVtree* mapped = stemTableOpen(tableName);
+			if(mapped){
+				/* the table stands in for the complete tree */
+				mapped->fallback = 1;
+				return mapped;
+			}
+			fprintf(stderr, "stem table %s unusable, building stems instead\n", tableName);
+		}
+	}
+	return stemTreeBuild(selectionFile);
+}
+
+RIVtree* stemTreeBuild(char* selectionFile){
 	#include "stemconfig/leafset.h"
 	
-	RIVtree* rootNode = calloc(treesize, sizeof(RIVtree));
+	/* sized once, for every leaf, so that building never rehashes */
+	RIVtree* rootNode = treeCreate(wordCount);
 	
 	
 	RIVtree* referenceTree = dummyTree(selectionFile);
-	nextNode = rootNode+1;
 
+	/* leafset lives on this stack frame: the tree keeps a copy to borrow from */
+	rootNode->keyBlock = malloc(sizeof(leafset));
+	memcpy(rootNode->keyBlock, leafset, sizeof(leafset));
 	char* stem = stemset;
-	char* leaf = leafset;
-	int stemDisplacement;
-	int leafDisplacement;
+	char* leaf = rootNode->keyBlock;
+	size_t stemDisplacement;
+	size_t leafDisplacement;
 	for(int i=0; i<wordCount; i++){
 		
-		sscanf(leaf, "%*s%n",&leafDisplacement);
-		sscanf(stem, "%*s%n", &stemDisplacement);
+		/* words are separated by single spaces (or, once a tree has been built
+		 * before, by nulls). sscanf would measure the whole remaining literal
+		 * for every word, making this quadratic */
+		leafDisplacement = strcspn(leaf, " ");
+		stemDisplacement = strcspn(stem, " ");
 		stem[stemDisplacement] = '\0';
 		leaf[leafDisplacement] = '\0';
 		if((!selectionFile) || treeSearch(referenceTree, stem)){
@@ -149,12 +417,118 @@ RIVtree* stemTreeSetup(char* selectionFile){
 		leaf += leafDisplacement+1;;
 	}
 	destroyTree(referenceTree);
+	rootNode->fallback = !selectionFile;
 	return rootNode;
 }
 
+int stemTableWrite(RIVtree* tree, const char* fileName){
+	/* a mapped tree has no slots of its own to write */
+	if(tree->table) return 1;
+	struct RIVtableHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, STEMTABLEMAGIC, sizeof(header.magic));
+	header.version = STEMTABLEVERSION;
+	header.groupSize = TREEGROUP;
+	header.capacity = tree->capacity;
+	header.count = tree->count;
+	struct RIVtableSlot* slots = calloc(tree->capacity, sizeof(struct RIVtableSlot));
+	char* strings = NULL;
+	size_t capacity = 0;
+	
+	/* every slot keeps its place, so the table probes exactly as the tree does */
+	for(size_t i=0; i<tree->capacity; i++){
+		if(tree->control[i] & 0x80) continue;
+		const char* pair[2] = {tree->slots[i].word, tree->slots[i].data};
+		uint32_t* offsets[2] = {&slots[i].word, &slots[i].data};
+		for(int j=0; j<2; j++){
+			size_t length = strlen(pair[j])+1;
+			if(header.stringsLength+length > capacity){
+				capacity = capacity? capacity*2: 1<<20;
+				strings = realloc(strings, capacity);
+			}
+			*offsets[j] = header.stringsLength;
+			memcpy(strings+header.stringsLength, pair[j], length);
+			header.stringsLength += length;
+		}
+		slots[i].hash = tree->slots[i].hash;
+	}
+	FILE* table = fopen(fileName, "wb");
+	int failed = !table;
+	if(table){
+		failed |= fwrite(&header, sizeof(header), 1, table) != 1;
+		failed |= fwrite(tree->control, 1, tree->capacity, table) != tree->capacity;
+		failed |= fwrite(slots, sizeof(struct RIVtableSlot), tree->capacity, table) != tree->capacity;
+		failed |= fwrite(strings, 1, header.stringsLength, table) != header.stringsLength;
+		failed |= fclose(table) != 0;
+	}
+	free(slots);
+	free(strings);
+	return failed;
+}
+
+RIVtree* stemTableOpen(const char* fileName){
+	int descriptor = open(fileName, O_RDONLY);
+	if(descriptor == -1) return NULL;
+	struct stat st;
+	if(fstat(descriptor, &st) || (size_t)st.st_size < sizeof(struct RIVtableHeader)){
+		close(descriptor);
+		return NULL;
+	}
+	/* shared and read only: every process using the table shares its pages */
+	char* table = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	close(descriptor);
+	if(table == MAP_FAILED) return NULL;
+	
+	const struct RIVtableHeader* header = (const struct RIVtableHeader*)table;
+	size_t capacity = header->capacity;
+	/* the sizes are checked against the file before they are multiplied, so
+	 * that no product can overflow */
+	if(memcmp(header->magic, STEMTABLEMAGIC, sizeof(STEMTABLEMAGIC))
+			|| header->version != STEMTABLEVERSION
+			|| header->groupSize != TREEGROUP
+			|| capacity < TREEGROUP || (capacity & (capacity-1))
+			|| capacity > (size_t)st.st_size
+			|| !header->stringsLength || header->stringsLength > (size_t)st.st_size
+			|| (size_t)st.st_size != sizeof(struct RIVtableHeader)
+				+capacity*(1+sizeof(struct RIVtableSlot))+header->stringsLength
+			|| table[st.st_size-1]){
+		munmap(table, st.st_size);
+		return NULL;
+	}
+	const unsigned char* control = (const unsigned char*)table+sizeof(struct RIVtableHeader);
+	const struct RIVtableSlot* slots = (const struct RIVtableSlot*)(control+capacity);
+	/* then every slot: a full one must point inside the strings (which end
+	 * on a null, so every string in them does) and carry its own hash's tag,
+	 * and there must be an empty slot somewhere, or a search for a missing
+	 * word would never end */
+	size_t full = 0;
+	int valid = 1;
+	for(size_t i=0; valid && i<capacity; i++){
+		if(control[i] == TREEEMPTY || control[i] == TREEDELETED) continue;
+		full++;
+		valid = !(control[i] & 0x80)
+			&& slots[i].word < header->stringsLength
+			&& slots[i].data < header->stringsLength
+			&& (slots[i].hash&0x7F) == control[i];
+	}
+	if(!valid || full != header->count || full+1 > capacity || !memchr(control, TREEEMPTY, capacity)){
+		munmap(table, st.st_size);
+		return NULL;
+	}
+	RIVtree* tree = calloc(1, sizeof(RIVtree));
+	tree->table = table;
+	tree->tableLength = st.st_size;
+	tree->control = (unsigned char*)control;
+	tree->tableSlots = slots;
+	tree->tableStrings = (const char*)(slots+capacity);
+	tree->capacity = capacity;
+	tree->count = header->count;
+	return tree;
+}
+
 RIVtree* dummyTree(char* fileName){
 	
-	RIVtree* rootNode = calloc(1, sizeof(RIVtree));
+	RIVtree* rootNode = treeCreate(0);
 	if(!fileName) return rootNode;
 	
 	FILE* file = fopen(fileName, "r");
@@ -173,98 +547,185 @@ RIVtree* dummyTree(char* fileName){
 	return rootNode;
 }
 	
-void* treeSearch(RIVtree* node, char* letter){
-	
-	
-	
-	if(*(letter)){
-		if(!node->links[*(letter)&ALPHAFILTER]){
-			return NULL;
-		}
-		
-		return treeSearch(node->links[*(letter)&ALPHAFILTER], letter+1);
-	}else{
-		
-		return node->data;
+uint32_t treeHash(const char* word){
+	/* FNV-1a, then mixed, so that both the high bits (slot) and
+	 * low bits (control byte) are well spread */
+	uint32_t hash = 2166136261u;
+	while(*word){
+		hash ^= (unsigned char)*(word++);
+		hash *= 16777619u;
 	}
+	hash ^= hash>>15;
+	hash *= 0x2c1b3c6du;
+	hash ^= hash>>12;
+	return hash;
 }
-void stemInsert(RIVtree* node, char* letter, void* data){
+
+int treeProbe(RIVtree* tree, const char* word, uint32_t hash, size_t* slot){
+	size_t groupMask = tree->capacity/TREEGROUP-1;
+	size_t group = (hash>>7)&groupMask;
+	unsigned char tag = hash&0x7F;
+	/* the first deleted slot passed, which can be reused by an insert */
+	size_t reusable = tree->capacity;
 	
-	node->downstream++;
-	if(*(letter)){
-		if(!node->links[(*letter)&ALPHAFILTER]){
-			node->links[(*letter)&ALPHAFILTER] = nextNode++;
-			
+	for(size_t step=1; ; step++){
+		unsigned char* control = tree->control+group*TREEGROUP;
+		int matches = 0;
+		int empties = 0;
+		#ifdef __SSE2__
+		__m128i bytes = _mm_loadu_si128((const __m128i*)control);
+		matches = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag)));
+		empties = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)TREEEMPTY)));
+		#else
+		for(int i=0; i<TREEGROUP; i++){
+			if(control[i] == tag) matches |= 1<<i;
+			if(control[i] == TREEEMPTY) empties |= 1<<i;
 		}
-		treeInsert(node->links[(*letter)&ALPHAFILTER], letter+1, data);
-		
-	}else{
-		
-		if(node->data) return;
-		node->data = data;
-		
+		#endif /* __SSE2__ */
+		while(matches){
+			size_t index = group*TREEGROUP+__builtin_ctz(matches);
+			if(tree->table){
+				const struct RIVtableSlot* entry = tree->tableSlots+index;
+				if(entry->hash == hash && !strcmp(tree->tableStrings+entry->word, word)){
+					*slot = index;
+					return 1;
+				}
+			}else if(tree->slots[index].hash == hash && !strcmp(tree->slots[index].word, word)){
+				*slot = index;
+				return 1;
+			}
+			matches &= matches-1;
+		}
+		if(reusable == tree->capacity){
+			for(int i=0; i<TREEGROUP; i++){
+				if(control[i] == TREEDELETED){
+					reusable = group*TREEGROUP+i;
+					break;
+				}
+			}
+		}
+		/* an empty slot ends the search: the word is not here */
+		if(empties){
+			*slot = reusable<tree->capacity? reusable: group*TREEGROUP+__builtin_ctz(empties);
+			return 0;
+		}
+		/* triangular steps visit every group of a power of two table */
+		group = (group+step)&groupMask;
+	}
+}
 
-		
+RIVtree* treeCreate(size_t expected){
+	RIVtree* tree = calloc(1, sizeof(RIVtree));
+	if(expected){
+		treeResize(tree, expected);
 	}
+	return tree;
 }
-void treeInsert(RIVtree* node, char* letter, void* data){
-	node->downstream++;
-	if(*(letter)){
-		
-		if(!node->links[(*letter)&ALPHAFILTER]){
-			node->links[(*letter)&ALPHAFILTER] = calloc(1, sizeof(RIVtree));
-			
-		}
-		treeInsert(node->links[(*letter)&ALPHAFILTER], letter+1, data);
-		
-	}else{
-		
-		if(node->data) return;
-		node->data = data;
-		
 
-		
+void treeResize(RIVtree* tree, size_t expected){
+	/* tables are kept no more than 7/8 full */
+	size_t capacity = TREEGROUP;
+	while(capacity*7/8 < expected){
+		capacity *= 2;
 	}
+	unsigned char* oldControl = tree->control;
+	struct RIVtreeSlot* oldSlots = tree->slots;
+	size_t oldCapacity = tree->capacity;
+	
+	tree->control = malloc(capacity);
+	memset(tree->control, TREEEMPTY, capacity);
+	tree->slots = malloc(capacity*sizeof(struct RIVtreeSlot));
+	tree->capacity = capacity;
+	tree->deleted = 0;
+	
+	/* every entry is moved to its place in the new table, dropping tombstones */
+	size_t slot;
+	for(size_t i=0; i<oldCapacity; i++){
+		if(oldControl[i] & 0x80) continue;
+		treeProbe(tree, oldSlots[i].word, oldSlots[i].hash, &slot);
+		tree->control[slot] = oldSlots[i].hash&0x7F;
+		tree->slots[slot] = oldSlots[i];
+	}
+	free(oldControl);
+	free(oldSlots);
 }
 
-int treecut(RIVtree* node, char* letter){
-	node->downstream--;
-	int flag;
-	//continue searching downstream if there is a letter
-	if(*(letter)){
-		if(node->links[*(letter) | ALPHAFILTER]){
-			//propagate to next section
-			flag = treecut(node->links[*(letter) &ALPHAFILTER], letter+1);
-			//if next section returned a "cut" flag, 0 it out
-			if(flag){
-				node->links[*(letter)&ALPHAFILTER] = NULL;
-			}
+void* treeSearch(RIVtree* tree, char* word){
+	size_t slot;
+	if(!tree->count) return NULL;
+	if(!treeProbe(tree, word, treeHash(word), &slot)){
+		return NULL;
+	}
+	if(tree->table){
+		return (void*)(tree->tableStrings+tree->tableSlots[slot].data);
+	}
+	return tree->slots[slot].data;
+}
+
+void treePlace(RIVtree* tree, char* word, void* data, int owned){
+	if(tree->table) return;
+	/* grow (or just clear out tombstones) before the table is too full */
+	if((tree->count+tree->deleted+1) > tree->capacity*7/8){
+		treeResize(tree, (tree->count+1)*2);
+	}
+	uint32_t hash = treeHash(word);
+	size_t slot;
+	if(treeProbe(tree, word, hash, &slot)){
+		if(!tree->slots[slot].data){
+			tree->slots[slot].data = data;
 		}
-	//there are no more letters, we've reached our destination
-	}else{
-		
-		node->data = NULL;
+		return;
 	}
-	//this is on a branch that leads nowhere, free it and return "cut" flag
-	if(!node->downstream){
-			
-		free(node);
-		return 1;
+	if(tree->control[slot] == TREEDELETED){
+		tree->deleted--;
 	}
-	return 0;
-	
-	
+	tree->control[slot] = hash&0x7F;
+	tree->slots[slot].word = owned? strdup(word): word;
+	tree->slots[slot].data = data;
+	tree->slots[slot].hash = hash;
+	tree->slots[slot].owned = owned;
+	tree->count++;
 }
-void destroyTree(RIVtree* node){
-	//if(node->data) free(node->data);
-	for(int i=0; i<32; i++){
-		if(node->links[i]){
-			
-			destroyTree(node->links[i]);
+
+void stemInsert(RIVtree* tree, char* word, void* data){
+	treePlace(tree, word, data, 0);
+}
+void treeInsert(RIVtree* tree, char* word, void* data){
+	treePlace(tree, word, data, 1);
+}
+
+int treecut(RIVtree* tree, char* word){
+	size_t slot;
+	if(!tree->count || tree->table) return 0;
+	if(!treeProbe(tree, word, treeHash(word), &slot)){
+		return 0;
+	}
+	if(tree->slots[slot].owned){
+		free((char*)tree->slots[slot].word);
+	}
+	/* a tombstone, so that searches for words placed after this one
+	 * continue past it */
+	tree->control[slot] = TREEDELETED;
+	tree->count--;
+	tree->deleted++;
+	return 1;
+}
+void destroyTree(RIVtree* tree){
+	//data is not freed, it belongs to whoever inserted it
+	if(tree->table){
+		munmap((void*)tree->table, tree->tableLength);
+		free(tree);
+		return;
+	}
+	for(size_t i=0; i<tree->capacity; i++){
+		if(!(tree->control[i] & 0x80) && tree->slots[i].owned){
+			free((char*)tree->slots[i].word);
 		}
-		
 	}
-	free(node);
+	free(tree->control);
+	free(tree->slots);
+	free(tree->keyBlock);
+	free(tree);
 	
 }
 
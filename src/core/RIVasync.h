@@ -0,0 +1,394 @@
+#ifndef RIVASYNC_H_
+#define RIVASYNC_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#ifdef __has_include
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+/* asynchronous reads of whole files, so that a program can ask for the
+ * files it will soon need, carry on working, and find them already in memory
+ * when it gets to them.  reads go through io_uring where the kernel allows
+ * it, and otherwise through a small pool of threads.  setting the environment
+ * variable RIVASYNC to "threads" forces the pool
+ */
+
+/* ASYNCRING is 1 where io_uring can be built: the system calls are known,
+ * and the header is new enough to have the read operation.  that operation
+ * is an enum constant, which the preprocessor cannot see, so the feature flag
+ * added in the same kernel release (IORING_FEAT_RW_CUR_POS) stands in for
+ * it.  a kernel which refuses the ring when the program runs gets the pool */
+#ifndef ASYNCRING
+#if defined(IORING_FEAT_RW_CUR_POS) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define ASYNCRING 1
+#else
+#define ASYNCRING 0
+#endif
+#endif
+
+/* ASYNCDEPTH is the most reads in flight through io_uring at once */
+#ifndef ASYNCDEPTH
+#define ASYNCDEPTH 256
+#endif
+
+/* ASYNCTHREADS is the size of the pool, when io_uring cannot be used */
+#ifndef ASYNCTHREADS
+#define ASYNCTHREADS 4
+#endif
+
+/* one file to be read.  the caller fills in "path" and submits it.  once
+ * done, "data" holds the file's "length" bytes, or "error" is set (ENOENT
+ * for a file which does not exist).  asyncReadFree releases it */
+struct asyncRead{
+	char path[200];
+	char* data;
+	size_t length;
+	int error;
+	int done;
+	/* private to the reader */
+	int fd;
+	struct asyncRead* next;
+};
+
+struct asyncReader{
+	/* the ring, if ringFd is not -1 */
+	int ringFd;
+	unsigned* sqHead;
+	unsigned* sqTail;
+	unsigned* sqMask;
+	unsigned* sqArray;
+	unsigned sqEntries;
+	unsigned* cqHead;
+	unsigned* cqTail;
+	unsigned* cqMask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sqRing;
+	void* cqRing;
+	size_t sqRingSize;
+	size_t cqRingSize;
+	size_t sqesSize;
+	unsigned inFlight;
+	/* the pool, otherwise, and its queue of reads not yet taken */
+	pthread_t threads[ASYNCTHREADS];
+	pthread_mutex_t lock;
+	pthread_cond_t queued;
+	pthread_cond_t completed;
+	struct asyncRead* head;
+	struct asyncRead* tail;
+	int closing;
+};
+
+/* starts a reader, through io_uring if possible */
+struct asyncReader* asyncOpen();
+
+/* begins reading read->path.  the read may complete at once (if the file
+ * cannot be opened, or is empty), and blocks only while the ring is full */
+void asyncSubmit(struct asyncReader* reader, struct asyncRead* read);
+
+/* waits until "read" is done */
+void asyncWait(struct asyncReader* reader, struct asyncRead* read);
+
+/* waits for everything submitted, then stops and frees the reader */
+void asyncClose(struct asyncReader* reader);
+
+/* frees a read which is done, with its data */
+void asyncReadFree(struct asyncRead* read);
+
+/* sets up the ring, returning 0 on success */
+int asyncRingOpen(struct asyncReader* reader);
+
+/* collects the reads the ring has completed. waits for at least one if
+ * "wait" is set */
+void asyncRingReap(struct asyncReader* reader, int wait);
+
+/* opens the file of a read, and allocates room for it. returns 0 if there
+ * is anything left to read */
+int asyncPrepare(struct asyncRead* read);
+
+/* reads the rest of a file synchronously, from "offset", and closes it */
+void asyncFinish(struct asyncRead* read, size_t offset);
+
+/* the body of each thread of the pool */
+void* asyncThread(void* readerV);
+
+
+/* begin definitions */
+
+struct asyncReader* asyncOpen(){
+	struct asyncReader* reader = calloc(1, sizeof(struct asyncReader));
+	reader->ringFd = -1;
+	char* backend = getenv("RIVASYNC");
+	if(!(backend && !strcmp(backend, "threads")) && !asyncRingOpen(reader)){
+		return reader;
+	}
+	pthread_mutex_init(&reader->lock, NULL);
+	pthread_cond_init(&reader->queued, NULL);
+	pthread_cond_init(&reader->completed, NULL);
+	for(int i=0; i<ASYNCTHREADS; i++){
+		pthread_create(&reader->threads[i], NULL, asyncThread, reader);
+	}
+	return reader;
+}
+
+int asyncRingOpen(struct asyncReader* reader){
+	#if ASYNCRING
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	int ringFd = syscall(__NR_io_uring_setup, ASYNCDEPTH, &params);
+	if(ringFd < 0){
+		return 1;
+	}
+	reader->sqRingSize = params.sq_off.array+params.sq_entries*sizeof(unsigned);
+	reader->cqRingSize = params.cq_off.cqes+params.cq_entries*sizeof(struct io_uring_cqe);
+	/* newer kernels map both rings at once */
+	int single = params.features & IORING_FEAT_SINGLE_MMAP;
+	if(single && reader->cqRingSize > reader->sqRingSize){
+		reader->sqRingSize = reader->cqRingSize;
+	}
+	reader->sqRing = mmap(NULL, reader->sqRingSize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if(reader->sqRing == MAP_FAILED){
+		close(ringFd);
+		return 1;
+	}
+	if(single){
+		reader->cqRing = reader->sqRing;
+	}else{
+		reader->cqRing = mmap(NULL, reader->cqRingSize, PROT_READ|PROT_WRITE,
+			MAP_SHARED|MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if(reader->cqRing == MAP_FAILED){
+			munmap(reader->sqRing, reader->sqRingSize);
+			close(ringFd);
+			return 1;
+		}
+	}
+	reader->sqesSize = params.sq_entries*sizeof(struct io_uring_sqe);
+	reader->sqes = mmap(NULL, reader->sqesSize, PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if(reader->sqes == MAP_FAILED){
+		munmap(reader->sqRing, reader->sqRingSize);
+		if(!single) munmap(reader->cqRing, reader->cqRingSize);
+		close(ringFd);
+		return 1;
+	}
+	char* sq = reader->sqRing;
+	char* cq = reader->cqRing;
+	reader->sqHead = (unsigned*)(sq+params.sq_off.head);
+	reader->sqTail = (unsigned*)(sq+params.sq_off.tail);
+	reader->sqMask = (unsigned*)(sq+params.sq_off.ring_mask);
+	reader->sqArray = (unsigned*)(sq+params.sq_off.array);
+	reader->sqEntries = params.sq_entries;
+	reader->cqHead = (unsigned*)(cq+params.cq_off.head);
+	reader->cqTail = (unsigned*)(cq+params.cq_off.tail);
+	reader->cqMask = (unsigned*)(cq+params.cq_off.ring_mask);
+	reader->cqes = (struct io_uring_cqe*)(cq+params.cq_off.cqes);
+	reader->ringFd = ringFd;
+	return 0;
+	#else
+	/* headers too old to know the read operation */
+	return 1;
+	#endif /* ASYNCRING */
+}
+
+int asyncPrepare(struct asyncRead* read){
+	read->fd = open(read->path, O_RDONLY);
+	if(read->fd < 0){
+		read->error = errno;
+		return 1;
+	}
+	struct stat st;
+	if(fstat(read->fd, &st)){
+		read->error = errno;
+		close(read->fd);
+		return 1;
+	}
+	read->length = st.st_size;
+	/* never 0 bytes, so that the data can always be handed on */
+	read->data = malloc(read->length+1);
+	if(!read->length){
+		close(read->fd);
+		return 1;
+	}
+	return 0;
+}
+
+void asyncFinish(struct asyncRead* read, size_t offset){
+	while(offset < read->length){
+		ssize_t count = pread(read->fd, read->data+offset, read->length-offset, offset);
+		if(count <= 0){
+			if(count < 0 && errno == EINTR) continue;
+			read->error = count? errno: EIO;
+			break;
+		}
+		offset += count;
+	}
+	close(read->fd);
+}
+
+void asyncSubmit(struct asyncReader* reader, struct asyncRead* read){
+	read->done = 0;
+	read->error = 0;
+	read->data = NULL;
+	read->length = 0;
+	if(reader->ringFd < 0){
+		read->next = NULL;
+		pthread_mutex_lock(&reader->lock);
+		if(reader->tail){
+			reader->tail->next = read;
+		}else{
+			reader->head = read;
+		}
+		reader->tail = read;
+		pthread_cond_signal(&reader->queued);
+		pthread_mutex_unlock(&reader->lock);
+		return;
+	}
+	#if ASYNCRING
+	/* the open is made here, so that only the read need wait on the disk */
+	if(asyncPrepare(read)){
+		read->done = 1;
+		return;
+	}
+	while(reader->inFlight == reader->sqEntries){
+		asyncRingReap(reader, 1);
+	}
+	unsigned tail = *reader->sqTail;
+	unsigned index = tail & *reader->sqMask;
+	struct io_uring_sqe* sqe = reader->sqes+index;
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = read->fd;
+	sqe->addr = (uint64_t)(uintptr_t)read->data;
+	sqe->len = read->length;
+	sqe->off = 0;
+	sqe->user_data = (uint64_t)(uintptr_t)read;
+	reader->sqArray[index] = index;
+	/* the entry must be complete before the kernel can see the new tail */
+	__atomic_store_n(reader->sqTail, tail+1, __ATOMIC_RELEASE);
+	reader->inFlight++;
+	if(syscall(__NR_io_uring_enter, reader->ringFd, 1, 0, 0, NULL, 0) < 0){
+		/* the entry stays queued, and is submitted with the next */
+	}
+	#endif /* ASYNCRING */
+}
+
+void asyncRingReap(struct asyncReader* reader, int wait){
+	#if ASYNCRING
+	while(1){
+		unsigned head = *reader->cqHead;
+		unsigned tail = __atomic_load_n(reader->cqTail, __ATOMIC_ACQUIRE);
+		if(head != tail){
+			for(; head != tail; head++){
+				struct io_uring_cqe* cqe = reader->cqes+(head & *reader->cqMask);
+				struct asyncRead* read = (struct asyncRead*)(uintptr_t)cqe->user_data;
+				if(cqe->res < 0){
+					if(cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP){
+						/* a kernel without the read operation */
+						asyncFinish(read, 0);
+					}else{
+						read->error = -cqe->res;
+						close(read->fd);
+					}
+				}else{
+					/* a short read is finished here */
+					asyncFinish(read, cqe->res);
+				}
+				read->done = 1;
+				reader->inFlight--;
+			}
+			__atomic_store_n(reader->cqHead, head, __ATOMIC_RELEASE);
+			return;
+		}
+		if(!wait || !reader->inFlight) return;
+		/* submits anything left unsubmitted, and sleeps for a completion */
+		unsigned pending = *reader->sqTail-__atomic_load_n(reader->sqHead, __ATOMIC_ACQUIRE);
+		syscall(__NR_io_uring_enter, reader->ringFd, pending, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	}
+	#endif /* ASYNCRING */
+}
+
+void asyncWait(struct asyncReader* reader, struct asyncRead* read){
+	if(reader->ringFd >= 0){
+		while(!read->done){
+			asyncRingReap(reader, 1);
+		}
+		return;
+	}
+	pthread_mutex_lock(&reader->lock);
+	while(!read->done){
+		pthread_cond_wait(&reader->completed, &reader->lock);
+	}
+	pthread_mutex_unlock(&reader->lock);
+}
+
+void* asyncThread(void* readerV){
+	struct asyncReader* reader = readerV;
+	pthread_mutex_lock(&reader->lock);
+	while(1){
+		while(!reader->head && !reader->closing){
+			pthread_cond_wait(&reader->queued, &reader->lock);
+		}
+		/* only exit once everything queued has been read */
+		if(!reader->head) break;
+		struct asyncRead* read = reader->head;
+		reader->head = read->next;
+		if(!reader->head) reader->tail = NULL;
+		pthread_mutex_unlock(&reader->lock);
+
+		if(!asyncPrepare(read)){
+			asyncFinish(read, 0);
+		}
+
+		pthread_mutex_lock(&reader->lock);
+		read->done = 1;
+		pthread_cond_broadcast(&reader->completed);
+	}
+	pthread_mutex_unlock(&reader->lock);
+	return NULL;
+}
+
+void asyncClose(struct asyncReader* reader){
+	if(reader->ringFd >= 0){
+		while(reader->inFlight){
+			asyncRingReap(reader, 1);
+		}
+		munmap(reader->sqes, reader->sqesSize);
+		if(reader->cqRing != reader->sqRing){
+			munmap(reader->cqRing, reader->cqRingSize);
+		}
+		munmap(reader->sqRing, reader->sqRingSize);
+		close(reader->ringFd);
+	}else{
+		pthread_mutex_lock(&reader->lock);
+		reader->closing = 1;
+		pthread_cond_broadcast(&reader->queued);
+		pthread_mutex_unlock(&reader->lock);
+		for(int i=0; i<ASYNCTHREADS; i++){
+			pthread_join(reader->threads[i], NULL);
+		}
+		pthread_mutex_destroy(&reader->lock);
+		pthread_cond_destroy(&reader->queued);
+		pthread_cond_destroy(&reader->completed);
+	}
+	free(reader);
+}
+
+void asyncReadFree(struct asyncRead* read){
+	free(read->data);
+	free(read);
+}
+
+#endif /* RIVASYNC_H_ */
@@ -0,0 +1,126 @@
+#ifndef RIVBAND_H_
+#define RIVBAND_H_
+
+#include "RIVlower.h"
+#include "RIVmath.h"
+
+#include <stddef.h>
+
+/* every near-duplicate search (RIVcull, RIVdedup, RIVjoin) narrows its
+ * comparisons the same way: two vectors whose magnitudes differ by more
+ * than a fraction of the larger are never duplicates, so a vector need only
+ * be compared with those whose magnitudes lie in a band around its own.
+ * the band is measured from the larger of each pair, so that whichever of
+ * two vectors is the one searched for, the same pairs are found.  a search
+ * over vectors kept in order of magnitude finds the band's ends by binary
+ * search, and a search over vectors in no order tests each magnitude.
+ *
+ * each candidate is compared with a dense copy of the vector searched for,
+ * made by bandProbe, and afterwards only that vector's locations are
+ * cleared, by bandRelease, rather than the whole dense vector
+ */
+
+/* BANDWIDTH is how far below the larger magnitude of two duplicates, as a
+ * fraction of it, the smaller may be */
+#ifndef BANDWIDTH
+#define BANDWIDTH 0.15
+#endif
+
+/* the magnitudes a duplicate of a vector may have, both ends excluded */
+typedef struct magnitudeBand{
+	double low;
+	double high;
+}magnitudeBand;
+
+/* gives the magnitude of the "index"th vector of a set kept in some form
+ * of the caller's */
+typedef float (*bandMagnitude)(const void* set, size_t index);
+
+/* the band around "magnitude", for a band "width" (as BANDWIDTH) */
+magnitudeBand bandAround(double magnitude, double width);
+
+/* whether "magnitude" lies within the band */
+int bandHolds(magnitudeBand band, double magnitude);
+
+/* whether a vector can have no duplicate at all: an empty vector, or one of
+ * no magnitude, is like no other */
+int bandEmpty(sparseRIV* vector);
+
+/* for a set of "count" vectors in order of magnitude, the first whose
+ * magnitude is above the band's low end, and the first (from "start") whose
+ * magnitude is at or above its high end.  the vectors of the band are those
+ * from the one to the other */
+size_t bandStart(magnitudeBand band, const void* set, size_t count, bandMagnitude magnitudeOf);
+size_t bandEnd(magnitudeBand band, const void* set, size_t start, size_t count, bandMagnitude magnitudeOf);
+
+/* maps a vector into "dense", which must be all zeros, to be compared with
+ * its candidates */
+void bandProbe(denseRIV* dense, sparseRIV* vector);
+
+/* zeroes "dense" again after bandProbe, by clearing only the vector's own
+ * locations */
+void bandRelease(denseRIV* dense, sparseRIV* vector);
+
+/* the magnitudes of an array of sparseRIV pointers, for bandStart */
+float bandSparseMagnitude(const void* set, size_t index);
+
+
+/* begin definitions */
+
+magnitudeBand bandAround(double magnitude, double width){
+	magnitudeBand band = {magnitude*(1-width), magnitude/(1-width)};
+	return band;
+}
+
+int bandHolds(magnitudeBand band, double magnitude){
+	return magnitude > band.low && magnitude < band.high;
+}
+
+int bandEmpty(sparseRIV* vector){
+	return !vector->count || vector->magnitude <= 0;
+}
+
+size_t bandStart(magnitudeBand band, const void* set, size_t count, bandMagnitude magnitudeOf){
+	size_t low = 0;
+	size_t high = count;
+	while(low < high){
+		size_t middle = low+(high-low)/2;
+		if(magnitudeOf(set, middle) <= band.low){
+			low = middle+1;
+		}else{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+size_t bandEnd(magnitudeBand band, const void* set, size_t start, size_t count, bandMagnitude magnitudeOf){
+	size_t low = start;
+	size_t high = count;
+	while(low < high){
+		size_t middle = low+(high-low)/2;
+		if(magnitudeOf(set, middle) < band.high){
+			low = middle+1;
+		}else{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+void bandProbe(denseRIV* dense, sparseRIV* vector){
+	addS2D(dense, vector);
+	dense->magnitude = vector->magnitude;
+}
+
+void bandRelease(denseRIV* dense, sparseRIV* vector){
+	for(size_t i=0; i<vector->count; i++){
+		dense->values[vector->locations[i]] = 0;
+	}
+}
+
+float bandSparseMagnitude(const void* set, size_t index){
+	return ((sparseRIV* const*)set)[index]->magnitude;
+}
+
+#endif /* RIVBAND_H_ */
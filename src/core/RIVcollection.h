@@ -0,0 +1,229 @@
+#ifndef RIVCOLLECTION_H_
+#define RIVCOLLECTION_H_
+
+#include "RIVlower.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* a collection is a file of named sparseRIVs, written once and read back
+ * without being parsed or copied: the reader maps the file, and hands out
+ * each vector as a sparseRIV lying in the mapping itself.  this lets
+ * vectors be made once (from text, or from a lexicon), and any analysis of
+ * them begin instantly, however many there are.
+ *
+ * the file is laid out as:
+ *  - a collectionHeader
+ *  - each vector's record, at a multiple of 8 bytes: an image of its
+ *    sparseRIV struct (name, count, frequency, contextSize and magnitude,
+ *    with the values pointer left 0), then its locations, then its values
+ *  - the offsets table: the offset of each record, 8 bytes apiece
+ * the header is only completed once everything else is written, so that an
+ * unfinished collection is never mistaken for a finished one.  as records
+ * are struct images, a collection is read only by builds with the same
+ * RIVSIZE and the same sparseRIV layout, which the header records
+ */
+#define COLLECTIONMAGIC "RIVCOLL"
+#define COLLECTIONVERSION 1
+
+/* the size of a record's sparseRIV image: the struct up to its locations */
+#define COLLECTIONIMAGE offsetof(sparseRIV, locations)
+
+struct collectionHeader{
+	char magic[8];
+	int version;
+	int rivSize;
+	/* the size of the sparseRIV image which begins each record */
+	unsigned long long recordSize;
+	unsigned long long count;
+	/* the offset of the offsets table */
+	unsigned long long table;
+};
+
+/* a collection being written */
+typedef struct RIVcollectionWriter{
+	FILE* file;
+	unsigned long long* offsets;
+	size_t count;
+	size_t capacity;
+	/* where the next record will be written */
+	unsigned long long position;
+	int failed;
+}RIVcollectionWriter;
+
+/* a collection being read */
+typedef struct RIVcollection{
+	char* map;
+	size_t length;
+	size_t count;
+	unsigned long long* offsets;
+	/* one bit for each record, set once it has been checked.  it is kept
+	 * here rather than in the records, whose bytes are the file's to say */
+	uint64_t* checked;
+}RIVcollection;
+
+/* creates (or truncates) a collection file to be written.
+ * returns NULL on failure */
+RIVcollectionWriter* collectionCreate(const char* path);
+
+/* appends a vector to the collection.  a NULL vector is written as an empty
+ * one, so that every vector of a list keeps its place. returns 0 on success */
+int collectionAppend(RIVcollectionWriter* writer, sparseRIV* vector);
+
+/* writes the offsets table and the header, and closes the file.  the writer
+ * is freed either way. returns 0 if the whole collection was written */
+int collectionFinish(RIVcollectionWriter* writer);
+
+/* maps a finished collection for reading. returns NULL if it cannot be
+ * opened, or was written by a build with other settings */
+RIVcollection* collectionOpen(const char* path);
+
+/* the vector at "index" of the collection, or NULL if it is out of range or
+ * corrupt.  the vector lies in the mapping, is valid until the collection is
+ * closed, and must not be freed.  it may be changed, but changes are private
+ * to this process and never reach the file */
+sparseRIV* collectionGet(RIVcollection* collection, size_t index);
+
+void collectionClose(RIVcollection* collection);
+
+
+/* begin definitions */
+
+RIVcollectionWriter* collectionCreate(const char* path){
+	FILE* file = fopen(path, "wb");
+	if(!file) return NULL;
+	RIVcollectionWriter* writer = calloc(1, sizeof(RIVcollectionWriter));
+	writer->file = file;
+	/* a blank header holds the place of the real one, written last */
+	struct collectionHeader header;
+	memset(&header, 0, sizeof(header));
+	writer->failed = fwrite(&header, sizeof(header), 1, file) != 1;
+	writer->position = sizeof(header);
+	return writer;
+}
+
+int collectionAppend(RIVcollectionWriter* writer, sparseRIV* vector){
+	if(writer->count == writer->capacity){
+		writer->capacity = writer->capacity? writer->capacity*2: 1024;
+		writer->offsets = realloc(writer->offsets, writer->capacity*sizeof(unsigned long long));
+	}
+	/* the image is built from the fields alone, so that neither the padding
+	 * nor the values pointer carries anything of this process into the file */
+	sparseRIV image;
+	memset(&image, 0, sizeof(image));
+	if(vector){
+		memcpy(image.name, vector->name, strnlen(vector->name, sizeof(image.name)-1));
+		image.count = vector->count;
+		image.frequency = vector->frequency;
+		image.contextSize = vector->contextSize;
+		image.magnitude = vector->magnitude;
+	}
+	static const char padding[8] = {0};
+	size_t dataSize = image.count*2*sizeof(int);
+	size_t paddingSize = (8-(COLLECTIONIMAGE+dataSize)%8)%8;
+
+	int failed = fwrite(&image, COLLECTIONIMAGE, 1, writer->file) != 1;
+	if(image.count){
+		failed |= fwrite(vector->locations, sizeof(int), image.count, writer->file) != image.count;
+		failed |= fwrite(vector->values, sizeof(int), image.count, writer->file) != image.count;
+	}
+	failed |= fwrite(padding, 1, paddingSize, writer->file) != paddingSize;
+
+	writer->offsets[writer->count++] = writer->position;
+	writer->position += COLLECTIONIMAGE+dataSize+paddingSize;
+	writer->failed |= failed;
+	return failed;
+}
+
+int collectionFinish(RIVcollectionWriter* writer){
+	struct collectionHeader header = {COLLECTIONMAGIC, COLLECTIONVERSION, RIVSIZE,
+		COLLECTIONIMAGE, writer->count, writer->position};
+	int failed = writer->failed;
+	failed |= fwrite(writer->offsets, sizeof(unsigned long long), writer->count, writer->file) != writer->count;
+	/* only now is the header made valid */
+	failed |= fflush(writer->file) != 0;
+	failed |= fseek(writer->file, 0, SEEK_SET) != 0;
+	failed |= fwrite(&header, sizeof(header), 1, writer->file) != 1;
+	failed |= fclose(writer->file) != 0;
+	free(writer->offsets);
+	free(writer);
+	return failed;
+}
+
+RIVcollection* collectionOpen(const char* path){
+	int descriptor = open(path, O_RDONLY);
+	if(descriptor < 0) return NULL;
+	struct stat st;
+	if(fstat(descriptor, &st) || (size_t)st.st_size < sizeof(struct collectionHeader)){
+		close(descriptor);
+		return NULL;
+	}
+	/* a private, writable mapping lets each record's values pointer be set
+	 * in place, without the file ever being changed */
+	char* map = mmap(NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if(map == MAP_FAILED) return NULL;
+
+	struct collectionHeader* header = (struct collectionHeader*)map;
+	if(memcmp(header->magic, COLLECTIONMAGIC, sizeof(header->magic))
+			|| header->version != COLLECTIONVERSION
+			|| header->rivSize != RIVSIZE
+			|| header->recordSize != COLLECTIONIMAGE
+			|| header->table%8
+			|| header->table < sizeof(struct collectionHeader)
+			|| header->table > (size_t)st.st_size
+			|| header->count > ((size_t)st.st_size-header->table)/sizeof(unsigned long long)){
+		munmap(map, st.st_size);
+		return NULL;
+	}
+	RIVcollection* collection = calloc(1, sizeof(RIVcollection));
+	collection->map = map;
+	collection->length = st.st_size;
+	collection->count = header->count;
+	collection->offsets = (unsigned long long*)(map+header->table);
+	collection->checked = calloc(collection->count/64+1, sizeof(uint64_t));
+	return collection;
+}
+
+sparseRIV* collectionGet(RIVcollection* collection, size_t index){
+	if(index >= collection->count) return NULL;
+	unsigned long long offset = collection->offsets[index];
+	unsigned long long table = ((struct collectionHeader*)collection->map)->table;
+	if(offset%8 || offset < sizeof(struct collectionHeader) || offset+COLLECTIONIMAGE > table){
+		return NULL;
+	}
+	sparseRIV* record = (sparseRIV*)(collection->map+offset);
+	/* a record is checked the first time it is asked for, and its values
+	 * pointer set over whatever the file held there.  threads which check
+	 * it at once all set the same pointer */
+	uint64_t bit = 1ULL<<(index%64);
+	if(__atomic_load_n(collection->checked+index/64, __ATOMIC_ACQUIRE) & bit){
+		return record;
+	}
+	if(!memchr(record->name, 0, sizeof(record->name))
+			|| record->count > RIVSIZE
+			|| record->count*2*sizeof(int) > table-offset-COLLECTIONIMAGE){
+		return NULL;
+	}
+	for(size_t i=0; i<record->count; i++){
+		if(record->locations[i] < 0 || record->locations[i] >= RIVSIZE) return NULL;
+	}
+	__atomic_store_n(&record->values, record->locations+record->count, __ATOMIC_RELAXED);
+	__atomic_fetch_or(collection->checked+index/64, bit, __ATOMIC_RELEASE);
+	return record;
+}
+
+void collectionClose(RIVcollection* collection){
+	munmap(collection->map, collection->length);
+	free(collection->checked);
+	free(collection);
+}
+
+#endif /* RIVCOLLECTION_H_ */
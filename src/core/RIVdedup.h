@@ -0,0 +1,265 @@
+#ifndef RIVDEDUP_H_
+#define RIVDEDUP_H_
+
+#include "RIVlower.h"
+#include "RIVmath.h"
+#include "RIVcollection.h"
+#include "RIVband.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/* a dedup index holds the vectors of every document seen so far, so that
+ * new documents can be checked for near-duplicates among them without the
+ * old ones being read or vectorized again.
+ *
+ * it is a directory of segments, each a collection (see RIVcollection.h)
+ * holding the vectors of one addition, sorted by magnitude, so that a new
+ * vector is compared only with the magnitude band (see RIVband.h) of each
+ * segment around its own.
+ *
+ * only writing is in proportion to the new documents alone: an addition
+ * writes one new segment, and changes nothing already written.  checking is
+ * not.  the band is the only filter, so each new document is still compared
+ * with every stored document of a similar magnitude, and that number grows
+ * with the index.  segments are compacted into one once there are more than
+ * DEDUPMAXSEGMENTS, so that each check makes one binary search rather than
+ * one per addition ever made
+ */
+
+/* DEDUPTHRESHOLD is the cosine above which two documents are duplicates */
+#ifndef DEDUPTHRESHOLD
+#define DEDUPTHRESHOLD 0.7
+#endif
+
+/* DEDUPBAND is the width of the magnitude band searched */
+#ifndef DEDUPBAND
+#define DEDUPBAND BANDWIDTH
+#endif
+
+/* DEDUPMAXSEGMENTS is the most segments an index is left with after an
+ * addition, before they are compacted into one */
+#ifndef DEDUPMAXSEGMENTS
+#define DEDUPMAXSEGMENTS 16
+#endif
+
+typedef struct dedupIndex{
+	char path[200];
+	RIVcollection** segments;
+	int segmentCount;
+}dedupIndex;
+
+/* opens the index in the directory "path", creating it if need be.
+ * returns NULL if it cannot be created, or holds a segment which cannot be
+ * read by this program */
+dedupIndex* dedupOpen(const char* path);
+
+/* checks each of "count" vectors against every vector in the index, and
+ * against each other, writing each duplicate found to output as
+ * "name<tab>name of duplicate<tab>cosine".  the vectors' magnitudes must be
+ * set. returns the number of duplicates found */
+int dedupCheck(dedupIndex* index, sparseRIV** vectors, int count, FILE* output);
+
+/* adds "count" vectors to the index, as a new segment, compacting the index
+ * if it then has more than DEDUPMAXSEGMENTS segments. returns 0 on success */
+int dedupAdd(dedupIndex* index, sparseRIV** vectors, int count);
+
+/* rewrites every segment of the index as one, sorted by magnitude.  the
+ * merged segment replaces the first, and the rest are removed from the last
+ * down, so that an interrupted compaction loses nothing, though it may leave
+ * some documents in the index twice.  returns 0 on success */
+int dedupCompact(dedupIndex* index);
+
+/* writes "count" vectors, sorted by magnitude, as the segment "number",
+ * under another name until whole.  returns 0 on success */
+int dedupWriteSegment(dedupIndex* index, int number, sparseRIV** vectors, size_t count);
+
+void dedupClose(dedupIndex* index);
+
+/* the path of segment "number" of the index */
+void dedupSegmentPath(dedupIndex* index, int number, char* pathString);
+
+/* the magnitude of a segment's "index"th vector, for bandStart.  a corrupt
+ * vector is taken to be above every band */
+float dedupMagnitude(const void* segment, size_t index);
+
+/* orders vectors by magnitude, for qsort */
+int dedupCompare(const void* a, const void* b);
+
+
+/* begin definitions */
+
+dedupIndex* dedupOpen(const char* path){
+	struct stat st = {0};
+	if(stat(path, &st) == -1 && mkdir(path, 0777)){
+		return NULL;
+	}
+	dedupIndex* index = calloc(1, sizeof(dedupIndex));
+	strncpy(index->path, path, sizeof(index->path)-1);
+	char pathString[300];
+	/* segments are numbered in the order they were added, from 0 */
+	while(1){
+		dedupSegmentPath(index, index->segmentCount, pathString);
+		if(stat(pathString, &st) == -1) break;
+		RIVcollection* segment = collectionOpen(pathString);
+		if(!segment){
+			fprintf(stderr, "dedup segment could not be read, %s\n", pathString);
+			dedupClose(index);
+			return NULL;
+		}
+		index->segments = realloc(index->segments, (index->segmentCount+1)*sizeof(RIVcollection*));
+		index->segments[index->segmentCount++] = segment;
+	}
+	return index;
+}
+
+void dedupSegmentPath(dedupIndex* index, int number, char* pathString){
+	sprintf(pathString, "%s/segment%06d.rivc", index->path, number);
+}
+
+float dedupMagnitude(const void* segment, size_t index){
+	sparseRIV* vector = collectionGet((RIVcollection*)segment, index);
+	return vector? vector->magnitude: INFINITY;
+}
+
+int dedupCompare(const void* a, const void* b){
+	float magnitudeA = (*(sparseRIV**)a)->magnitude;
+	float magnitudeB = (*(sparseRIV**)b)->magnitude;
+	return (magnitudeA > magnitudeB)-(magnitudeA < magnitudeB);
+}
+
+int dedupCheck(dedupIndex* index, sparseRIV** vectors, int count, FILE* output){
+	int found = 0;
+	/* the new vectors are sorted too, so that each one's band among the
+	 * others lies just before it */
+	sparseRIV** sorted = malloc((count+1)*sizeof(sparseRIV*));
+	memcpy(sorted, vectors, count*sizeof(sparseRIV*));
+	qsort(sorted, count, sizeof(sparseRIV*), dedupCompare);
+	denseRIV* baseDense = calloc(1, sizeof(denseRIV));
+
+	for(int i=0; i<count; i++){
+		sparseRIV* vector = sorted[i];
+		if(bandEmpty(vector)) continue;
+		bandProbe(baseDense, vector);
+		magnitudeBand band = bandAround(vector->magnitude, DEDUPBAND);
+
+		for(int j=0; j<index->segmentCount; j++){
+			RIVcollection* segment = index->segments[j];
+			size_t start = bandStart(band, segment, segment->count, dedupMagnitude);
+			size_t end = bandEnd(band, segment, start, segment->count, dedupMagnitude);
+			for(size_t k=start; k<end; k++){
+				/* a corrupt vector may still lie inside the band's ends */
+				sparseRIV* other = collectionGet(segment, k);
+				if(!other) continue;
+				double cosine = RIVcosCompare(baseDense, other);
+				if(cosine > DEDUPTHRESHOLD){
+					fprintf(output, "%s\t%s\t%f\n", vector->name, other->name, cosine);
+					found++;
+				}
+			}
+		}
+		for(int j=bandStart(band, sorted, i, bandSparseMagnitude); j<i; j++){
+			double cosine = RIVcosCompare(baseDense, sorted[j]);
+			if(cosine > DEDUPTHRESHOLD){
+				fprintf(output, "%s\t%s\t%f\n", vector->name, sorted[j]->name, cosine);
+				found++;
+			}
+		}
+		bandRelease(baseDense, vector);
+	}
+	free(baseDense);
+	free(sorted);
+	return found;
+}
+
+int dedupWriteSegment(dedupIndex* index, int number, sparseRIV** vectors, size_t count){
+	char pathString[300];
+	char tempString[310];
+	dedupSegmentPath(index, number, pathString);
+	/* the segment is written under another name, and renamed once whole, so
+	 * that an interrupted write leaves the index as it was */
+	sprintf(tempString, "%s.tmp", pathString);
+
+	sparseRIV** sorted = malloc((count+1)*sizeof(sparseRIV*));
+	memcpy(sorted, vectors, count*sizeof(sparseRIV*));
+	qsort(sorted, count, sizeof(sparseRIV*), dedupCompare);
+
+	RIVcollectionWriter* writer = collectionCreate(tempString);
+	int failed = !writer;
+	for(size_t i=0; !failed && i<count; i++){
+		failed = collectionAppend(writer, sorted[i]);
+	}
+	free(sorted);
+	if(writer && collectionFinish(writer)) failed = 1;
+	if(failed || rename(tempString, pathString)){
+		remove(tempString);
+		return 1;
+	}
+	return 0;
+}
+
+int dedupAdd(dedupIndex* index, sparseRIV** vectors, int count){
+	char pathString[300];
+	if(dedupWriteSegment(index, index->segmentCount, vectors, count)){
+		return 1;
+	}
+	dedupSegmentPath(index, index->segmentCount, pathString);
+	RIVcollection* segment = collectionOpen(pathString);
+	if(!segment) return 1;
+	index->segments = realloc(index->segments, (index->segmentCount+1)*sizeof(RIVcollection*));
+	index->segments[index->segmentCount++] = segment;
+	if(index->segmentCount > DEDUPMAXSEGMENTS){
+		return dedupCompact(index);
+	}
+	return 0;
+}
+
+int dedupCompact(dedupIndex* index){
+	if(index->segmentCount < 2) return 0;
+	size_t total = 0;
+	for(int i=0; i<index->segmentCount; i++){
+		total += index->segments[i]->count;
+	}
+	/* the vectors are written from the old segments' mappings, which stay
+	 * valid until those segments are closed */
+	sparseRIV** vectors = malloc((total+1)*sizeof(sparseRIV*));
+	size_t count = 0;
+	for(int i=0; i<index->segmentCount; i++){
+		for(size_t j=0; j<index->segments[i]->count; j++){
+			sparseRIV* vector = collectionGet(index->segments[i], j);
+			if(!vector){
+				free(vectors);
+				return 1;
+			}
+			vectors[count++] = vector;
+		}
+	}
+	int failed = dedupWriteSegment(index, 0, vectors, count);
+	free(vectors);
+	if(failed) return 1;
+
+	char pathString[300];
+	for(int i=index->segmentCount-1; i>0; i--){
+		dedupSegmentPath(index, i, pathString);
+		remove(pathString);
+	}
+	for(int i=0; i<index->segmentCount; i++){
+		collectionClose(index->segments[i]);
+	}
+	dedupSegmentPath(index, 0, pathString);
+	index->segments[0] = collectionOpen(pathString);
+	index->segmentCount = index->segments[0]? 1: 0;
+	return !index->segments[0];
+}
+
+void dedupClose(dedupIndex* index){
+	for(int i=0; i<index->segmentCount; i++){
+		collectionClose(index->segments[i]);
+	}
+	free(index->segments);
+	free(index);
+}
+
+#endif /* RIVDEDUP_H_ */
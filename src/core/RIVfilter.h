@@ -0,0 +1,146 @@
+#ifndef RIVFILTER_H_
+#define RIVFILTER_H_
+
+#include "RIVaccessories.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+
+/* a word filter knows which words of a lexicon have files, so that a word
+ * without one can be known as new (or refused) at once, rather than by a
+ * failed open.  it is either exact, a set of every word, or a Bloom filter,
+ * which takes a few bits per word however long the words are, at the price
+ * of sometimes answering "maybe" for a word which has no file.  neither ever
+ * answers "no" for a word which has one, so a "maybe" is only ever settled by
+ * opening the file, just as it would have been without a filter
+ */
+
+/* FILTERBITS is the bits a Bloom filter gives each word it is sized for, and
+ * FILTERHASHES the bits it sets for each word.  10 and 7 give under 1% of
+ * words without files a "maybe" */
+#ifndef FILTERBITS
+#define FILTERBITS 10
+#endif
+
+#ifndef FILTERHASHES
+#define FILTERHASHES 7
+#endif
+
+/* FILTERMINWORDS is the fewest words a Bloom filter is sized for */
+#ifndef FILTERMINWORDS
+#define FILTERMINWORDS 65536
+#endif
+
+typedef struct wordFilter{
+	/* the words, if exact */
+	RIVtree* words;
+	/* the bits, if a Bloom filter, and their number (a power of 2) */
+	uint64_t* bits;
+	size_t bitCount;
+}wordFilter;
+
+/* builds a filter of the files in "directory" (but those beginning with '.'),
+ * as a Bloom filter if "bloom" is set, and an exact set if not.
+ * returns NULL if the directory cannot be read */
+wordFilter* filterOpen(const char* directory, int bloom);
+
+/* returns 0 if "word" surely has no file, and 1 if it may have */
+int filterMayHold(wordFilter* filter, const char* word);
+
+/* records that "word" has a file */
+void filterAdd(wordFilter* filter, char* word);
+
+void filterClose(wordFilter* filter);
+
+/* the hash a Bloom filter's bits are taken from, FNV-1a in 64 bits */
+uint64_t filterHash(const char* word);
+
+
+/* begin definitions */
+
+wordFilter* filterOpen(const char* directory, int bloom){
+	DIR* listing = opendir(directory);
+	if(!listing){
+		return NULL;
+	}
+	/* the words are counted first, so that the filter is built at its size */
+	size_t wordCount = 0;
+	struct dirent* files;
+	while((files = readdir(listing))){
+		if(*(files->d_name) != '.') wordCount++;
+	}
+	rewinddir(listing);
+
+	wordFilter* filter = calloc(1, sizeof(wordFilter));
+	if(bloom){
+		/* room for as many words again before it fills */
+		size_t sized = wordCount*2 > FILTERMINWORDS? wordCount*2: FILTERMINWORDS;
+		filter->bitCount = 64;
+		while(filter->bitCount < sized*FILTERBITS){
+			filter->bitCount *= 2;
+		}
+		filter->bits = calloc(filter->bitCount/64, sizeof(uint64_t));
+	}else{
+		filter->words = treeCreate(wordCount);
+	}
+	while((files = readdir(listing))){
+		if(*(files->d_name) == '.') continue;
+		filterAdd(filter, files->d_name);
+	}
+	closedir(listing);
+	return filter;
+}
+
+uint64_t filterHash(const char* word){
+	uint64_t hash = 14695981039346656037ULL;
+	while(*word){
+		hash ^= (unsigned char)*(word++);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+int filterMayHold(wordFilter* filter, const char* word){
+	if(filter->words){
+		return treeSearch(filter->words, (char*)word) != NULL;
+	}
+	/* each of the bits is taken from two halves of one hash */
+	uint64_t hash = filterHash(word);
+	uint64_t step = (hash>>32)|1;
+	size_t mask = filter->bitCount-1;
+	for(int i=0; i<FILTERHASHES; i++){
+		size_t bit = (hash+i*step)&mask;
+		if(!(filter->bits[bit/64] & (1ULL<<(bit%64)))){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void filterAdd(wordFilter* filter, char* word){
+	if(filter->words){
+		/* any data will do, as long as it is not NULL */
+		treeInsert(filter->words, word, filter);
+		return;
+	}
+	uint64_t hash = filterHash(word);
+	uint64_t step = (hash>>32)|1;
+	size_t mask = filter->bitCount-1;
+	for(int i=0; i<FILTERHASHES; i++){
+		size_t bit = (hash+i*step)&mask;
+		filter->bits[bit/64] |= 1ULL<<(bit%64);
+	}
+}
+
+void filterClose(wordFilter* filter){
+	if(filter->words){
+		destroyTree(filter->words);
+	}
+	free(filter->bits);
+	free(filter);
+}
+
+#endif /* RIVFILTER_H_ */
@@ -0,0 +1,196 @@
+#ifndef RIVINPUT_H_
+#define RIVINPUT_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "RIVtokenizer.h"
+
+/* the input layer feeds corpus text to the tokenizer. regular files are
+ * mapped into memory whole, and read by the kernel ahead of us, so that
+ * a corpus is read at the speed of memory rather than one libc call per
+ * word. pipes and stdin, which cannot be mapped, are streamed through a
+ * buffer instead. either way text is handed out in lines or blocks which
+ * never split a word, and which are not null terminated
+ */
+
+/* INPUTCHUNK is the size of each read when streaming */
+#ifndef INPUTCHUNK
+#define INPUTCHUNK (1<<20)
+#endif
+
+typedef struct RIVinput{
+	int descriptor;
+	/* whether we opened the descriptor, and so must close it */
+	int owned;
+	/* mapped inputs: the entire text. streamed inputs: the buffered window */
+	char* text;
+	size_t length;
+	size_t cursor;
+	size_t capacity;
+	int mapped;
+	int exhausted;
+}RIVinput;
+
+/* opens a file for input, or stdin if path is "-". returns NULL on failure */
+RIVinput* inputOpen(const char* path);
+
+/* wraps an already open descriptor, which will be left open by inputClose */
+RIVinput* inputFromDescriptor(int descriptor);
+
+/* points "line" at the next line of input and returns its length
+ * (including its newline, if any). returns 0 once the input is exhausted.
+ * the line is valid until the next call */
+size_t inputNextLine(RIVinput* input, const char** line);
+
+/* points "block" at as much of the remaining input as is available (all of
+ * it, if mapped), ending on whitespace so that no word is split. returns
+ * its length, 0 once exhausted.  the block is valid until the next call */
+size_t inputNextBlock(RIVinput* input, const char** block);
+
+void inputClose(RIVinput* input);
+
+/* streaming only: reads more text into the buffer, keeping whatever has
+ * not yet been handed out. returns 0 once nothing more can be read */
+int inputRefill(RIVinput* input);
+
+
+/* begin definitions */
+
+RIVinput* inputOpen(const char* path){
+	if(!strcmp(path, "-")){
+		return inputFromDescriptor(STDIN_FILENO);
+	}
+	int descriptor = open(path, O_RDONLY);
+	if(descriptor == -1){
+		return NULL;
+	}
+	RIVinput* input = inputFromDescriptor(descriptor);
+	input->owned = 1;
+	return input;
+}
+
+RIVinput* inputFromDescriptor(int descriptor){
+	RIVinput* input = calloc(1, sizeof(RIVinput));
+	input->descriptor = descriptor;
+
+	struct stat st;
+	if(!fstat(descriptor, &st) && S_ISREG(st.st_mode) && st.st_size > 0){
+		void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if(map != MAP_FAILED){
+			/* we read front to back, once: let the kernel read ahead aggressively
+			 * and drop pages behind us */
+			madvise(map, st.st_size, MADV_SEQUENTIAL);
+			madvise(map, st.st_size, MADV_WILLNEED);
+			input->text = map;
+			input->length = st.st_size;
+			input->mapped = 1;
+			input->exhausted = 1;
+			return input;
+		}
+	}
+	/* an empty file is simply an exhausted stream */
+	if(!fstat(descriptor, &st) && S_ISREG(st.st_mode) && !st.st_size){
+		input->exhausted = 1;
+	}
+	return input;
+}
+
+int inputRefill(RIVinput* input){
+	if(input->exhausted) return 0;
+
+	/* slide the unread text to the front of the buffer */
+	size_t remaining = input->length-input->cursor;
+	if(input->cursor){
+		memmove(input->text, input->text+input->cursor, remaining);
+		input->cursor = 0;
+		input->length = remaining;
+	}
+	if(input->capacity-input->length < INPUTCHUNK){
+		input->capacity = input->capacity? input->capacity*2: INPUTCHUNK;
+		while(input->capacity-input->length < INPUTCHUNK){
+			input->capacity *= 2;
+		}
+		input->text = realloc(input->text, input->capacity);
+	}
+	ssize_t readCount;
+	do{
+		readCount = read(input->descriptor, input->text+input->length, input->capacity-input->length);
+	}while(readCount == -1 && errno == EINTR);
+	if(readCount <= 0){
+		input->exhausted = 1;
+		return 0;
+	}
+	input->length += readCount;
+	return 1;
+}
+
+size_t inputNextLine(RIVinput* input, const char** line){
+	char* newline;
+	/* how much of this line has already been searched, so that a line
+	 * spanning many reads is still only searched once */
+	size_t searched = 0;
+	while(input->length == input->cursor+searched
+			|| !(newline = memchr(input->text+input->cursor+searched, '\n', input->length-input->cursor-searched))){
+		searched = input->length-input->cursor;
+		/* the line continues past what we hold. if nothing more can be read,
+		 * what remains is the last line */
+		if(!inputRefill(input)){
+			size_t length = input->length-input->cursor;
+			*line = input->text+input->cursor;
+			input->cursor = input->length;
+			return length;
+		}
+	}
+	size_t length = newline+1-(input->text+input->cursor);
+	*line = input->text+input->cursor;
+	input->cursor += length;
+	return length;
+}
+
+size_t inputNextBlock(RIVinput* input, const char** block){
+	if(input->cursor == input->length){
+		if(!inputRefill(input)) return 0;
+	}
+	size_t length = input->length-input->cursor;
+	if(!input->exhausted){
+		/* hold back a word which may continue into the next read */
+		while(length && !ISTOKENSPACE(input->text[input->cursor+length-1])){
+			length--;
+		}
+		/* a single word larger than the whole buffer: read until it ends */
+		while(!length){
+			if(!inputRefill(input)){
+				length = input->length-input->cursor;
+				break;
+			}
+			length = input->length-input->cursor;
+			while(length && !ISTOKENSPACE(input->text[input->cursor+length-1])){
+				length--;
+			}
+		}
+	}
+	*block = input->text+input->cursor;
+	input->cursor += length;
+	return length;
+}
+
+void inputClose(RIVinput* input){
+	if(input->mapped){
+		munmap(input->text, input->length);
+	}else{
+		free(input->text);
+	}
+	if(input->owned){
+		close(input->descriptor);
+	}
+	free(input);
+}
+
+#endif /* RIVINPUT_H_ */
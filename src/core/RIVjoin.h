@@ -0,0 +1,225 @@
+#ifndef RIVJOIN_H_
+#define RIVJOIN_H_
+
+#include "RIVlower.h"
+#include "RIVmath.h"
+#include "RIVcollection.h"
+#include "RIVband.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* a join finds, for two collections of vectors A and B, every pair of a
+ * vector from A and one from B whose cosine is above a threshold: which
+ * documents of a new crawl have near-duplicates in an archive, say.
+ *
+ * the smaller collection is indexed, by sorting it on magnitude, so that
+ * each vector of the larger is compared only with the magnitude band (see
+ * RIVband.h) of the index around its own.  the larger collection is divided
+ * among threads, each with a dense vector of its own for the comparisons
+ */
+
+/* JOINBAND is the width of the magnitude band searched */
+#ifndef JOINBAND
+#define JOINBAND BANDWIDTH
+#endif
+
+/* JOINCHUNK is the number of vectors a thread takes at once */
+#ifndef JOINCHUNK
+#define JOINCHUNK 64
+#endif
+
+/* JOINBUFFER is the number of pairs a thread holds before writing them */
+#ifndef JOINBUFFER
+#define JOINBUFFER 1024
+#endif
+
+/* one pair found, as written in binary: the indexes of the two vectors in
+ * their collections, and their cosine. a binary pair list is nothing but
+ * these, one after another */
+struct joinPair{
+	unsigned int a;
+	unsigned int b;
+	float cosine;
+};
+
+/* joins the collections setA and setB with threadCount threads (0 for one
+ * per processor), writing each pair whose cosine is above threshold to
+ * output, as a joinPair if binary is set, or otherwise as the line
+ * "name in A<tab>name in B<tab>cosine".  pairs are written in no particular
+ * order.  returns the number of pairs, or -1 if either collection is
+ * corrupt or the output could not be written */
+long collectionJoin(RIVcollection* setA, RIVcollection* setB, double threshold, int threadCount, FILE* output, int binary);
+
+/* an entry of the index: a vector of the smaller collection, and its place */
+struct joinEntry{
+	float magnitude;
+	unsigned int index;
+	sparseRIV* vector;
+};
+
+/* shared by the threads of one join */
+struct joinJob{
+	RIVcollection* setA;
+	RIVcollection* setB;
+	RIVcollection* probes;
+	struct joinEntry* entries;
+	size_t entryCount;
+	/* whether the probes are set A, so that pairs are written A first */
+	int probesAreA;
+	double threshold;
+	FILE* output;
+	int binary;
+	/* the next probe to be claimed */
+	size_t cursor;
+	long found;
+	int failed;
+	pthread_mutex_t lock;
+};
+
+/* the body of each joining thread */
+void* joinThread(void* jobV);
+
+/* writes a thread's pairs out, under the job's lock */
+void joinFlush(struct joinJob* job, struct joinPair* pairs, int count);
+
+/* orders index entries by magnitude, for qsort */
+int joinCompare(const void* a, const void* b);
+
+/* the magnitude of an index entry, for bandStart */
+float joinMagnitude(const void* entries, size_t index);
+
+
+/* begin definitions */
+
+long collectionJoin(RIVcollection* setA, RIVcollection* setB, double threshold, int threadCount, FILE* output, int binary){
+	if(threadCount < 1){
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+		if(threadCount < 1) threadCount = 1;
+	}
+	struct joinJob job = {0};
+	job.setA = setA;
+	job.setB = setB;
+	/* the smaller side is the one indexed */
+	RIVcollection* indexed = setA->count <= setB->count? setA: setB;
+	job.probes = indexed == setA? setB: setA;
+	job.probesAreA = job.probes == setA;
+	job.threshold = threshold;
+	job.output = output;
+	job.binary = binary;
+
+	job.entries = malloc((indexed->count+1)*sizeof(struct joinEntry));
+	for(size_t i=0; i<indexed->count; i++){
+		sparseRIV* vector = collectionGet(indexed, i);
+		if(!vector){
+			free(job.entries);
+			return -1;
+		}
+		if(bandEmpty(vector)) continue;
+		struct joinEntry* entry = job.entries+job.entryCount++;
+		entry->magnitude = vector->magnitude;
+		entry->index = i;
+		entry->vector = vector;
+	}
+	qsort(job.entries, job.entryCount, sizeof(struct joinEntry), joinCompare);
+	pthread_mutex_init(&job.lock, NULL);
+
+	pthread_t* threads = malloc(threadCount*sizeof(pthread_t));
+	for(int i=0; i<threadCount; i++){
+		pthread_create(&threads[i], NULL, joinThread, &job);
+	}
+	for(int i=0; i<threadCount; i++){
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&job.lock);
+	free(job.entries);
+
+	if(job.failed || fflush(output)) return -1;
+	return job.found;
+}
+
+float joinMagnitude(const void* entries, size_t index){
+	return ((const struct joinEntry*)entries)[index].magnitude;
+}
+
+int joinCompare(const void* a, const void* b){
+	float magnitudeA = ((struct joinEntry*)a)->magnitude;
+	float magnitudeB = ((struct joinEntry*)b)->magnitude;
+	return (magnitudeA > magnitudeB)-(magnitudeA < magnitudeB);
+}
+
+void* joinThread(void* jobV){
+	struct joinJob* job = (struct joinJob*)jobV;
+	denseRIV* baseDense = calloc(1, sizeof(denseRIV));
+	struct joinPair* pairs = malloc(JOINBUFFER*sizeof(struct joinPair));
+	int pairCount = 0;
+	int corrupt = 0;
+
+	while(1){
+		size_t start = __atomic_fetch_add(&job->cursor, JOINCHUNK, __ATOMIC_RELAXED);
+		if(start >= job->probes->count) break;
+		size_t stop = start+JOINCHUNK < job->probes->count? start+JOINCHUNK: job->probes->count;
+
+		for(size_t i=start; i<stop; i++){
+			sparseRIV* vector = collectionGet(job->probes, i);
+			if(!vector){
+				corrupt = 1;
+				continue;
+			}
+			if(bandEmpty(vector)) continue;
+			magnitudeBand band = bandAround(vector->magnitude, JOINBAND);
+			size_t start = bandStart(band, job->entries, job->entryCount, joinMagnitude);
+			size_t end = bandEnd(band, job->entries, start, job->entryCount, joinMagnitude);
+			/* only a vector with candidates is worth mapping to the dense vector */
+			if(start == end) continue;
+
+			bandProbe(baseDense, vector);
+			for(size_t j=start; j<end; j++){
+				double cosine = RIVcosCompare(baseDense, job->entries[j].vector);
+				if(cosine <= job->threshold) continue;
+
+				struct joinPair* pair = pairs+pairCount++;
+				pair->a = job->probesAreA? i: job->entries[j].index;
+				pair->b = job->probesAreA? job->entries[j].index: i;
+				pair->cosine = cosine;
+				if(pairCount == JOINBUFFER){
+					joinFlush(job, pairs, pairCount);
+					pairCount = 0;
+				}
+			}
+			bandRelease(baseDense, vector);
+		}
+	}
+	joinFlush(job, pairs, pairCount);
+	if(corrupt){
+		pthread_mutex_lock(&job->lock);
+		job->failed = 1;
+		pthread_mutex_unlock(&job->lock);
+	}
+	free(baseDense);
+	free(pairs);
+	return NULL;
+}
+
+void joinFlush(struct joinJob* job, struct joinPair* pairs, int count){
+	if(!count) return;
+	pthread_mutex_lock(&job->lock);
+	if(job->binary){
+		job->failed |= fwrite(pairs, sizeof(struct joinPair), count, job->output) != (size_t)count;
+	}else{
+		for(int i=0; i<count; i++){
+			/* both vectors have been checked already, and so are never NULL */
+			sparseRIV* vectorA = collectionGet(job->setA, pairs[i].a);
+			sparseRIV* vectorB = collectionGet(job->setB, pairs[i].b);
+			job->failed |= fprintf(job->output, "%s\t%s\t%f\n", vectorA->name, vectorB->name, pairs[i].cosine) < 0;
+		}
+	}
+	job->found += count;
+	pthread_mutex_unlock(&job->lock);
+}
+
+#endif /* RIVJOIN_H_ */
@@ -0,0 +1,335 @@
+#ifndef RIV_LEXMERGE_H
+#define RIV_LEXMERGE_H
+
+#include "RIVlower.h"
+#include "RIVlexicon.h"
+#include "RIVaccessories.h"
+
+#include <dirent.h>
+#include <pthread.h>
+
+/* a lexicon vector is nothing more than the sum of its contexts. so
+ * lexica built separately, from separate parts of a corpus, can be merged
+ * into exactly the lexicon that one build over the whole corpus would have
+ * produced, by summing their values, frequencies, and contextSizes.
+ * this allows a large build to be split across processes or machines
+ * (RIVread on each shard) and reduced afterwards
+ */
+
+/* lexMerge combines inputCount lexica into the lexicon outName, which is
+ * created if necessary.  words are merged one at a time, each by a single
+ * thread, threadCount threads at once (0 for one per processor).
+ * any word already in outName is overwritten, so to merge into an existing
+ * lexicon it should also be listed among the inputs.
+ * returns the number of words which failed to merge, or -1 if any lexicon
+ * was built with settings other than this program's
+ */
+int lexMerge(const char* outName, char** inputNames, int inputCount, int threadCount);
+
+/* what a compaction keeps, and how it rewrites what it keeps */
+struct compactOptions{
+	/* words seen fewer times, or in fewer contexts, are dropped */
+	int minFrequency;
+	int minContextSize;
+	/* if above 0, every vector kept is scaled to this magnitude, as by
+	 * trueNormalize.  a lexicon so rescaled can no longer be merged.  no
+	 * vector of integers is shorter than 1, so a magnitude below that is
+	 * refused */
+	double magnitude;
+};
+
+/* the results of a compaction */
+struct compactStats{
+	int kept;
+	int dropped;
+	/* vectors written dense, the rest being sparse */
+	int dense;
+	/* the size of the vectors read, and of those written */
+	unsigned long long bytesRead;
+	unsigned long long bytesWritten;
+};
+
+/* lexCompact rewrites the lexicon inName, in one pass, as outName: each
+ * vector is written in whichever form (sparse or dense) is now lighter, words
+ * below the thresholds of "options" are dropped, and those kept are
+ * optionally rescaled.  outName may be inName itself, to compact it in
+ * place, in which case each word is written to a hidden file and renamed
+ * over its old one, so that an interrupted compaction loses nothing.  a word
+ * whose file cannot be read (as one cut short may not be), or whose every
+ * value rounds to 0 when rescaled, is counted as a failure, and left as it
+ * was in place, or left out of a new lexicon.
+ * "stats", if not NULL, receives what was done.  words are compacted
+ * threadCount at once (0 for one thread per processor).
+ * returns the number of words which failed, or -1 if either lexicon was
+ * built with settings other than this program's, or the magnitude is below 1
+ */
+int lexCompact(const char* outName, const char* inName, struct compactOptions* options, int threadCount, struct compactStats* stats);
+
+/* gathers the names of every word in any of the lexica, each once */
+char** mergeWordList(char** inputNames, int inputCount, int* wordCount);
+
+/* the body of each merging thread */
+void* mergeThread(void* jobV);
+
+/* shared by all threads of one lexMerge or lexCompact call */
+struct mergeJob{
+	const char* outName;
+	char** inputNames;
+	int inputCount;
+	char** words;
+	int wordCount;
+	/* what to drop and rescale, if compacting */
+	struct compactOptions* options;
+	/* whether the output is the input, so that words are replaced in place */
+	int inPlace;
+	struct compactStats stats;
+	/* the next word to be claimed by a thread */
+	int cursor;
+	int failures;
+	pthread_mutex_t lock;
+};
+
+/* lists the job's words, and merges them threadCount at once */
+void mergeRun(struct mergeJob* job, int threadCount);
+
+/* writes one staged word of a job, in place if need be. returns 0 on success */
+int mergeWrite(struct mergeJob* job, char* word, int* stagingSlot, int intCount);
+
+/* scales a vector to "magnitude", as trueNormalize does, using "scratch"
+ * (2*RIVSIZE ints) for its scaled values.  returns 1, with the vector left
+ * as it was, if every value would round to 0 */
+int compactScale(denseRIV* vector, double magnitude, int* scratch);
+
+/* begin definitions */
+
+int lexMerge(const char* outName, char** inputNames, int inputCount, int threadCount){
+	struct stat st = {0};
+	if(stat(outName, &st) == -1){
+		mkdir(outName, 0777);
+	}
+	/* summing vectors of different dimensions would be meaningless */
+	for(int i=0; i<inputCount; i++){
+		if(lexHeaderCheck(inputNames[i], 0)) return -1;
+	}
+	if(lexHeaderCheck(outName, 1)) return -1;
+	struct mergeJob job = {0};
+	job.outName = outName;
+	job.inputNames = inputNames;
+	job.inputCount = inputCount;
+	mergeRun(&job, threadCount);
+	return job.failures;
+}
+
+int lexCompact(const char* outName, const char* inName, struct compactOptions* options, int threadCount, struct compactStats* stats){
+	struct stat inStat = {0};
+	struct stat outStat = {0};
+	if(stat(inName, &inStat) == -1 || lexHeaderCheck(inName, 0)) return -1;
+	if(options && options->magnitude > 0 && options->magnitude < 1) return -1;
+	if(stat(outName, &outStat) == -1){
+		mkdir(outName, 0777);
+		stat(outName, &outStat);
+	}
+	if(lexHeaderCheck(outName, 1)) return -1;
+	struct compactOptions none = {0};
+	struct mergeJob job = {0};
+	job.outName = outName;
+	job.inputNames = (char**)&inName;
+	job.inputCount = 1;
+	job.options = options? options: &none;
+	/* the same directory, however it is named */
+	job.inPlace = inStat.st_dev == outStat.st_dev && inStat.st_ino == outStat.st_ino;
+	if(job.inPlace){
+		/* an interrupted compaction may have left its hidden files behind */
+		DIR* directory = opendir(inName);
+		struct dirent* files;
+		char pathString[300];
+		while(directory && (files = readdir(directory))){
+			if(!strncmp(files->d_name, ".compact.", 9)){
+				snprintf(pathString, sizeof(pathString), "%s/%s", inName, files->d_name);
+				remove(pathString);
+			}
+		}
+		if(directory) closedir(directory);
+	}
+	mergeRun(&job, threadCount);
+	if(stats){
+		*stats = job.stats;
+	}
+	return job.failures;
+}
+
+void mergeRun(struct mergeJob* job, int threadCount){
+	if(threadCount < 1){
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+		if(threadCount < 1) threadCount = 1;
+	}
+	job->words = mergeWordList(job->inputNames, job->inputCount, &job->wordCount);
+	pthread_mutex_init(&job->lock, NULL);
+
+	pthread_t* threads = malloc(threadCount*sizeof(pthread_t));
+	for(int i=0; i<threadCount; i++){
+		pthread_create(&threads[i], NULL, mergeThread, job);
+	}
+	for(int i=0; i<threadCount; i++){
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&job->lock);
+
+	for(int i=0; i<job->wordCount; i++){
+		free(job->words[i]);
+	}
+	free(job->words);
+}
+
+int mergeWrite(struct mergeJob* job, char* word, int* stagingSlot, int intCount){
+	if(!job->inPlace){
+		return writeStaged(job->outName, word, stagingSlot, intCount);
+	}
+	/* a hidden file, which no walk over the lexicon will take for a word,
+	 * until it is renamed over the old one whole */
+	char hidden[120];
+	char hiddenPath[300];
+	char pathString[300];
+	snprintf(hidden, sizeof(hidden), ".compact.%s", word);
+	if(writeStaged(job->outName, hidden, stagingSlot, intCount)){
+		return 1;
+	}
+	snprintf(hiddenPath, sizeof(hiddenPath), "%s/%s", job->outName, hidden);
+	snprintf(pathString, sizeof(pathString), "%s/%s", job->outName, word);
+	if(rename(hiddenPath, pathString)){
+		remove(hiddenPath);
+		return 1;
+	}
+	return 0;
+}
+
+int compactScale(denseRIV* vector, double magnitude, int* scratch){
+	double current = getMagnitudeDense(vector);
+	/* a 0 vector has no direction to keep */
+	if(current <= 0) return 0;
+	int* values = scratch;
+	int* locations = scratch+RIVSIZE;
+	size_t count = scaleValues(vector->values, NULL, RIVSIZE, magnitude/current, 0, values, locations);
+	/* a vector with nothing left would replace the word with nothing */
+	if(!count) return 1;
+	memset(vector->values, 0, RIVSIZE*sizeof(int));
+	for(size_t i=0; i<count; i++){
+		vector->values[locations[i]] = values[i];
+	}
+	vector->magnitude = getMagnitudeDense(vector);
+	return 0;
+}
+
+char** mergeWordList(char** inputNames, int inputCount, int* wordCount){
+	/* the tree ensures that a word found in several lexica is listed once */
+	RIVtree* seen = treeCreate(0);
+	int* seenFlag = (int*)1;
+	char** words = NULL;
+	int capacity = 0;
+	*wordCount = 0;
+
+	for(int i=0; i<inputCount; i++){
+		DIR* directory = opendir(inputNames[i]);
+		if(!directory){
+			fprintf(stderr, "lexicon not found, %s\n", inputNames[i]);
+			continue;
+		}
+		struct dirent* files;
+		while((files = readdir(directory))){
+			/* lexica hold no hidden files or sub-directories worth merging */
+			if(*(files->d_name) == '.') continue;
+			if(files->d_type == DT_DIR) continue;
+			if(treeSearch(seen, files->d_name)) continue;
+
+			treeInsert(seen, files->d_name, seenFlag);
+			if(*wordCount == capacity){
+				capacity = capacity? capacity*2: 1024;
+				words = realloc(words, capacity*sizeof(char*));
+			}
+			words[(*wordCount)++] = strdup(files->d_name);
+		}
+		closedir(directory);
+	}
+	destroyTree(seen);
+	return words;
+}
+
+void* mergeThread(void* jobV){
+	struct mergeJob* job = (struct mergeJob*)jobV;
+	/* each thread has its own accumulator and its own read and write slots,
+	 * so nothing but the cursor is shared */
+	denseRIV* accumulate = malloc(sizeof(denseRIV));
+	int* readSlot = malloc(2*RIVSIZE*sizeof(int));
+	int* stagingBlock = malloc((3*RIVSIZE+5)*sizeof(int));
+	int* stagingSlot = stagingBlock+RIVSIZE;
+	char pathString[300];
+
+	while(1){
+		pthread_mutex_lock(&job->lock);
+		int index = job->cursor++;
+		pthread_mutex_unlock(&job->lock);
+		if(index >= job->wordCount) break;
+
+		char* word = job->words[index];
+		memset(accumulate, 0, sizeof(denseRIV));
+		strcpy(accumulate->name, word);
+		int failed = 0;
+		int dropped = 0;
+		int intCount = 0;
+		long bytesRead = 0;
+
+		/* sum this word's vector from every lexicon which holds it */
+		for(int i=0; i<job->inputCount; i++){
+			sprintf(pathString, "%s/%s", job->inputNames[i], word);
+			FILE* lexWord = fopen(pathString, "rb");
+			if(!lexWord) continue;
+			if(fLexAdd(lexWord, accumulate, readSlot)){
+				fprintf(stderr, "vector read failure: %s\n", pathString);
+				failed = 1;
+			}
+			bytesRead += ftell(lexWord);
+			fclose(lexWord);
+		}
+		if(!failed && job->options){
+			/* a word seen too rarely to be useful is left out */
+			if(accumulate->frequency < job->options->minFrequency
+					|| accumulate->contextSize < job->options->minContextSize){
+				dropped = 1;
+				/* and, in place, removed */
+				if(job->inPlace){
+					sprintf(pathString, "%s/%s", job->outName, word);
+					failed = remove(pathString) != 0;
+				}
+			}else if(job->options->magnitude > 0){
+				/* the read slot is free again once the word is summed */
+				if(compactScale(accumulate, job->options->magnitude, readSlot)){
+					fprintf(stderr, "vector rescaled to nothing: %s\n", word);
+					failed = 1;
+				}
+			}
+		}
+		if(!failed && !dropped){
+			intCount = stageForWrite(accumulate, stagingSlot);
+			failed = mergeWrite(job, word, stagingSlot, intCount);
+		}
+		pthread_mutex_lock(&job->lock);
+		if(failed){
+			job->failures++;
+		}else if(dropped){
+			job->stats.dropped++;
+		}else{
+			job->stats.kept++;
+			job->stats.dense += intCount == RIVSIZE+5;
+			job->stats.bytesWritten += intCount*sizeof(int);
+		}
+		job->stats.bytesRead += bytesRead;
+		pthread_mutex_unlock(&job->lock);
+	}
+	free(accumulate);
+	free(readSlot);
+	free(stagingBlock);
+	return NULL;
+}
+
+#endif /* RIV_LEXMERGE_H */
@@ -4,10 +4,17 @@
 #include "RIVlower.h"
 #include "RIVmath.h"
 #include "RIVaccessories.h"
+#include "RIVtrace.h"
+#include "RIVasync.h"
+#include "RIVpool.h"
+#include "RIVfilter.h"
 
 
 #include <signal.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
 #include <sys/stat.h>
 
 
@@ -29,6 +36,10 @@
 #define CACHEFLAG 0x08
 #endif
 
+#ifndef TRACKFLAG
+#define TRACKFLAG 0x10
+#endif
+
 /* if user has specified neither hashed nor sorted cache we assume sorted
  * hashed strategy is extremely CPU and memory light, but very inneffective 
  * at ensuring the most important vectors are cached. as such it is better
@@ -41,6 +52,125 @@
 		#define SORTCACHE
 	#endif
 #endif
+
+/* WRITERCOUNT macro defines the number of background threads which write
+ * evicted vectors out to the lexicon.  0 keeps every write synchronous,
+ * any other number requires compiling with -pthread */
+#ifndef WRITERCOUNT
+#define WRITERCOUNT 0
+#endif
+
+#if WRITERCOUNT<0
+#error "WRITERCOUNT cannot be a negative number"
+#endif
+
+/* WRITEQUEUESIZE macro defines how many vectors may wait on each writer
+ * before lexPush blocks, waiting for the writer to catch up */
+#ifndef WRITEQUEUESIZE
+#define WRITEQUEUESIZE 64
+#endif
+
+/* LEXPOOL macro gives each lexicon a pool of denseRIV buffers (see
+ * RIVpool.h), which the vectors it pulls are taken from and those it writes
+ * or drops are given back to.  0, the default, allocates and frees each
+ * vector alone.  a program which sets it must drop vectors with lexRelease
+ * rather than free(), and give every vector back before lexClose, which
+ * unmaps the pool */
+#ifndef LEXPOOL
+#define LEXPOOL 0
+#endif
+
+/* LEXFILTER macro selects the word filter (see RIVfilter.h) each lexicon
+ * loads when opened, and keeps up to date as it writes, so that a word with
+ * no file is known without trying to open one: 0 for none, 1 for an exact
+ * set of the words, and 2 for a Bloom filter, for lexica too large to hold
+ * every word in memory.  the filter only knows of files this lexicon wrote, or
+ * found when opened, so a lexicon written by two programs at once needs 0 */
+#ifndef LEXFILTER
+#define LEXFILTER 1
+#endif
+
+/* LEXSTATS macro enables the lexicon's counters and timers (see lexStats).
+ * 0 compiles them away entirely */
+#ifndef LEXSTATS
+#define LEXSTATS 1
+#endif
+
+/* every lexicon counts what it does, and how long it takes, so that
+ * CACHESIZE and the cache strategy can be tuned from data.
+ * counters are updated atomically, as background writers share them.
+ * times are in nanoseconds */
+struct lexStats{
+	/* calls to lexPull, and where each was answered from */
+	unsigned long long pulls;
+	unsigned long long cacheHits;
+	unsigned long long writerHits;
+	unsigned long long fileHits;
+	unsigned long long newWords;
+	/* unknown words refused by an exclusive lexicon */
+	unsigned long long refusals;
+	/* pulls of words the filter knew had no file, which opened nothing */
+	unsigned long long filterSkips;
+	/* files read ahead by lexPrefetch, and pulls which found theirs waiting */
+	unsigned long long prefetches;
+	unsigned long long prefetchHits;
+	/* calls to lexPush, how many the cache kept, and how many vectors were
+	 * pushed out of the cache to make room */
+	unsigned long long pushes;
+	unsigned long long cacheStores;
+	unsigned long long evictions;
+	/* the files of the lexicon, and the data read and written through them */
+	unsigned long long fileOpens;
+	unsigned long long bytesRead;
+	unsigned long long bytesWritten;
+	unsigned long long sparseWrites;
+	unsigned long long denseWrites;
+	unsigned long long writeFailures;
+	unsigned long long pullTime;
+	unsigned long long pushTime;
+	unsigned long long readTime;
+	unsigned long long writeTime;
+};
+
+#if LEXSTATS
+#define STATSADD(stats, field, amount) __atomic_fetch_add(&(stats)->field, (amount), __ATOMIC_RELAXED)
+#define STATSCLOCK() statsClock()
+#else
+#define STATSADD(stats, field, amount) ((void)0)
+#define STATSCLOCK() 0ULL
+#endif /* LEXSTATS */
+
+#if WRITERCOUNT > 0
+#include <pthread.h>
+
+/* each writer owns a bounded queue of vectors waiting to be written.
+ * a word is always sent to the same writer, so that two writes of one
+ * word can never race each other to the disk */
+struct writeBack{
+	const char* lexName;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	/* signalled when a vector is queued, or the writer is told to close */
+	pthread_cond_t filled;
+	/* signalled when a vector leaves the queue, or finishes staging */
+	pthread_cond_t drained;
+	denseRIV* queue[WRITEQUEUESIZE];
+	int head;
+	int count;
+	/* the vector currently being written, and whether its data has been
+	 * copied into the stagingSlot yet (after which it can be reclaimed) */
+	denseRIV* inFlight;
+	int staged;
+	int reclaimed;
+	int closing;
+	int failures;
+	int* stagingBlock;
+	struct lexStats* stats;
+	/* where written vectors are given back to */
+	densePool* pool;
+};
+#endif /* WRITERCOUNT > 0 */
+
 /* the LEXICON struct will be used similar to a FILE (as a pointer) which
  * contains all metadata that a lexicon needs in order to be read and written to safely*/
 typedef struct{
@@ -48,18 +178,36 @@ typedef struct{
 	denseRIV* *cache;
 	struct cacheList* listPoint;
 	char flags;
+	struct lexStats stats;
+	/* where, if anywhere, to report the final stats when closing */
+	FILE* statsOutput;
+	#if WRITERCOUNT > 0
+	/* background writers, only present if the lexicon is open for writing */
+	struct writeBack* writers;
+	#endif /* WRITERCOUNT > 0 */
 	#ifdef SORTCACHE
 	/* if our cache is sorted, we will need a search tree and a saturation */
 	RIVtree* treeRoot;
 	int cacheSaturation;
 	denseRIV* *cache_slider;
 	#endif /* SORTCACHE */
+	/* files being read ahead of their pulls, by word, once lexPrefetch is used */
+	struct asyncReader* reader;
+	RIVtree* ahead;
+	/* the buffers of the lexicon's vectors, if LEXPOOL is set */
+	densePool* pool;
+	/* the words with files, if LEXFILTER is set */
+	wordFilter* filter;
 }LEXICON;
 /* this will form a linked list of caches, so that all data can be safely dumped
  * in event of an error, no matter how many or how strangely lexica have
  * been opened and closed */
 struct cacheList{
 	denseRIV* *cache;
+	#if WRITERCOUNT > 0
+	/* queued writes must be secured along with the cache */
+	struct writeBack* writers;
+	#endif /* WRITERCOUNT > 0 */
 	struct cacheList* next;
 	struct cacheList* prev;
 }*rootCache = NULL;
@@ -78,15 +226,58 @@ int* IOstagingSlot = tempBlock+RIVSIZE;
  * although it will be cached if possible, so that later pulls will be optimized
  * x: exclusive. will not accept new words, lexPull returns a NULL pointer
  * and lexPush simply frees any word which is not already in the lexicon
+ * t: tracked. every vector pulled is tracked (see denseTrack), so that its
+ * magnitude is known without a scan, and a dense write needs no counting
  */
 LEXICON* lexOpen(const char* lexName, const char* flags);
 
+/* LEXHEADER names the file, within each lexicon, which records the settings
+ * the lexicon was built with.  it begins with '.', so walks over the words of
+ * a lexicon skip it along with "." and ".." */
+#define LEXHEADER ".header"
+
+/* the settings a lexicon was built with.  its vectors are only meaningful to
+ * programs compiled with the same dimensions and the same barcode generator */
+struct lexHeader{
+	int rivSize;
+	int nonZeros;
+	int generator;
+};
+
+/* lexHeaderRead reads the header of the lexicon lexName into "output".
+ * returns 0 on success, 1 if the lexicon has no header (as lexica made before
+ * headers were recorded do not), and 2 if the header is malformed
+ */
+int lexHeaderRead(const char* lexName, struct lexHeader* output);
+
+/* lexHeaderWrite records this program's settings as the header of lexName.
+ * returns 0 on success */
+int lexHeaderWrite(const char* lexName);
+
+/* lexHeaderCheck returns 0 if lexName was built with this program's settings.
+ * if not, it says why on stderr and returns 1.  a lexicon without a header is
+ * given this program's, if "writing" and it has no words yet, and otherwise
+ * trusted, as it always was.  called by lexOpen, which refuses mismatches
+ */
+int lexHeaderCheck(const char* lexName, int writing);
+
 /* lexClose should always be called after the last lex push or lex pull call
  * if the lexicon is left open, some vector data may be lost due to 
  * un-flushed RIV cache.  also frees up data, memory leaks if lexicon is not closed
  */
 void lexClose(LEXICON*);
 
+/* lexStatsGet copies the lexicon's stats so far into "output" */
+void lexStatsGet(LEXICON* lexicon, struct lexStats* output);
+
+/* lexStatsPrint writes the lexicon's stats so far to "output", as a single
+ * line of JSON */
+void lexStatsPrint(LEXICON* lexicon, FILE* output);
+
+/* lexStatsReport asks for the final stats, including the writes made by
+ * closing the lexicon, to be printed to "output" by lexClose */
+void lexStatsReport(LEXICON* lexicon, FILE* output);
+
 /* both lexPush and lexPull must be called *after* the lexOpen() function
  * and after using them the lexClose() function must be called to ensure
  * data security (only after the final push or pull, not regularly during operation */
@@ -97,10 +288,54 @@ int lexPush(LEXICON* lexicon, denseRIV* RIVout);
 /* lexPull reads a denseRIV from the lexicon, under "word"
  * if the file does not exist, it creates a 0 vector with the name of word
  * lexPull returns a denseRIV *pointer* because its data must be tracked 
- * globally for key optimizations
+ * globally for key optimizations.  the vector belongs to the lexicon, and
+ * must be given back to it, with lexPush or lexRelease, before it is closed
  */
 denseRIV* lexPull(LEXICON* lexicon, char* word);
 
+/* lexRelease lets go of a pulled vector without pushing it, as free() once
+ * did, though a vector in the cache is left there.  with LEXPOOL set, a
+ * pulled vector must never be freed directly */
+void lexRelease(LEXICON* lexicon, denseRIV* vector);
+
+/* lexPullSparse reads a word's vector in the sparse form it is stored in,
+ * for analysis which only reads the lexicon: a word stored sparse is read
+ * straight into its sparseRIV, with no denseRIV made on the way, and only
+ * one stored dense, or held in memory, is consolidated.  the vector is the
+ * caller's, to be freed, and is never pushed back.  an unknown word gives an
+ * empty vector if the lexicon is inclusive, and NULL if not
+ */
+sparseRIV* lexPullSparse(LEXICON* lexicon, char* word);
+
+/* lexPullMany pulls the vectors of wordCount words at once, as for a line or
+ * block of text, into output[i] for words[i] (NULL where lexPull would give NULL).
+ * a repeated word is pulled once, and each of its places in output holds the
+ * same vector.  cached words are served at once, and the files of the rest
+ * are opened together, prefetched, and read in the order they lie on disk.
+ * the vectors must be returned with lexPushMany, before any other pull or push.
+ * returns the number of distinct words
+ */
+int lexPullMany(LEXICON* lexicon, char** words, int wordCount, denseRIV** output);
+
+/* lexPushMany pushes back the vectors of a lexPullMany, each once however
+ * often it appears.  NULL entries are skipped. returns the number of pushes
+ * which failed
+ */
+int lexPushMany(LEXICON* lexicon, denseRIV** vectors, int count);
+
+/* lexPrefetch starts reading the files of words which will soon be pulled,
+ * in the background, so that their pulls need not wait on the disk.  words
+ * already in memory, or already being read, are left alone.  a file read
+ * ahead is only used by the next pull of its word, which must come before
+ * any push of it.  returns the number of reads started
+ */
+int lexPrefetch(LEXICON* lexicon, char** words, int wordCount);
+
+/* LEXPULLBATCH is the most files lexPullMany holds open at once */
+#ifndef LEXPULLBATCH
+#define LEXPULLBATCH 256
+#endif
+
 /* cacheCheckOnPush tests the state of this vector in our lexicon cache
  * and returns 1 on "success" indicating cache storage and no need to push to file
  * or returns 0 on "failure" indicating that the vector need be pushed to file 
@@ -119,6 +354,43 @@ int cacheCheckOnPush(LEXICON* lexicon, denseRIV* RIVout);
  */
 denseRIV* cacheCheckOnPull(LEXICON* lexicon, char* word);
 
+/* lexPullHeld finds a word in the lexicon's memory, its cache or a writer's
+ * queue, and returns NULL if it is in neither */
+denseRIV* lexPullHeld(LEXICON* lexicon, char* word);
+
+/* lexPullFile makes the vector of a word which is not held, from its open
+ * file (closing it), or from nothing if lexWord is NULL.  readStart is when
+ * the read began, for the lexicon's stats */
+denseRIV* lexPullFile(LEXICON* lexicon, char* word, FILE* lexWord, unsigned long long readStart);
+
+/* whether a word is in the lexicon's memory, without taking it from there */
+int lexHolds(LEXICON* lexicon, char* word);
+
+/* returns 0 if a word surely has no file in the lexicon, and 1 if it may,
+ * or if the lexicon has no filter.  a word it says has none is counted as a
+ * skipped open */
+int lexMayHold(LEXICON* lexicon, char* word);
+
+/* takes the read lexPrefetch started for a word, if there is one */
+struct asyncRead* lexPrefetchTake(LEXICON* lexicon, char* word);
+
+/* makes the vector of a word which is not held, from its read ahead file */
+denseRIV* lexPullAhead(LEXICON* lexicon, char* word, struct asyncRead* ahead);
+
+/* waits for and frees every read still ahead, for lexClose */
+void lexPrefetchClose(LEXICON* lexicon);
+
+/* one file opened by lexPullMany, waiting to be read */
+struct lexPending{
+	int index;
+	int fd;
+	ino_t inode;
+	unsigned long long opened;
+};
+
+/* reads the files of lexPullMany in the order of their inodes */
+void lexPullPending(LEXICON* lexicon, char** words, struct lexPending* pending, int pendingCount, denseRIV** output);
+
 /* fLexPush pushes the data contained in a denseRIV out to a lexicon file,
  * saving it for long-term aggregation.  function is called by "lexPush",
  * which is what users should actually use.  lexPush, unlike fLexPush,
@@ -129,18 +401,85 @@ int fLexPush(LEXICON* lexicon, denseRIV* RIVout);
 /* flexPull pulls data directly from a file and outputs it as a denseRIV.
  * function is called by "lexPull" which is what users 
  * should actually use.  lexPull, unlike FlexPull, has cache logic under
- * the hood for speed and harddrive optimization 
+ * the hood for speed and harddrive optimization.
+ * vectors stored sparse come back tracked, as counting them is nearly free
  */
 denseRIV* fLexPull(FILE* lexWord);
 
+/* fLexPullPooled is fLexPull, taking the vector from "pool" (if not NULL) */
+denseRIV* fLexPullPooled(FILE* lexWord, densePool* pool);
+
+/* fLexPullSparse reads a lexicon file as a sparseRIV, consolidating it if it
+ * is stored dense.  like fLexAdd it touches no shared memory.  returns NULL
+ * for a malformed file
+ */
+sparseRIV* fLexPullSparse(FILE* lexWord);
+
+/* fLexAdd reads the vector stored in a lexicon file and adds it, along with
+ * its frequency and contextSize, to "output".  unlike fLexPull it touches
+ * no shared memory, using only the readSlot it is given (room for 2*RIVSIZE
+ * integers), so that many threads may read the lexicon at once.
+ * returns 0 on success, 1 on a malformed file
+ */
+int fLexAdd(FILE* lexWord, denseRIV* output, int* readSlot);
+
 /* redefines signal behavior to protect cached data against seg-faults etc*/
 void signalSecure(int signum, siginfo_t *si, void* arg);
 int cacheDump(denseRIV* *toDump);
 
 /* used exclusively by flexpush to determine write-style (sparse or dense)
- * and also formats the "IOstagingSlot" for fwrite as a single block if sparse
+ * and also formats the stagingSlot for fwrite as a single block if sparse
+ */
+int saturationForStaging(denseRIV* output, int* stagingSlot);
+
+/* lays a denseRIV into the stagingSlot in its on-disk format (sparse or
+ * dense, whichever is lighter) and returns the number of integers to write
  */
-int saturationForStaging(denseRIV* output);
+int stageForWrite(denseRIV* output, int* stagingSlot);
+
+/* writes a staged vector to the lexicon file of the word "name" */
+int writeStaged(const char* lexName, const char* name, int* stagingSlot, int intCount);
+
+/* records one write of a staged vector, which took "time" */
+void statsCountWrite(struct lexStats* stats, int intCount, int failed, unsigned long long time);
+
+/* a monotonic clock, in nanoseconds */
+unsigned long long statsClock();
+
+/* lexWriteBack is the single exit of vectors from the lexicon's memory.
+ * it hands the vector to a background writer if the lexicon has them,
+ * and calls fLexPush otherwise. a lexicon not open for writing frees it */
+int lexWriteBack(LEXICON* lexicon, denseRIV* RIVout);
+
+#if WRITERCOUNT > 0
+/* starts the lexicon's writers, called by lexOpen for writable lexica */
+struct writeBack* writeBackOpen(const char* lexName, struct lexStats* stats, densePool* pool);
+
+/* writes out everything still queued, then stops and frees the writers.
+ * returns the number of writes which failed */
+int writeBackClose(struct writeBack* writers);
+
+/* queues a vector on the writer responsible for its word, blocking
+ * while that writer's queue is full */
+void writeBackPush(struct writeBack* writers, denseRIV* RIVout);
+
+/* if "word" is waiting to be written, takes it back out of the queue and
+ * returns it.  returns NULL if the word is not waiting on any writer */
+denseRIV* writeBackReclaim(struct writeBack* writers, char* word);
+
+/* the body of each writer thread */
+void* writeBackThread(void* writerV);
+
+/* writes out queued vectors synchronously, and the one being written if
+ * its writer's lock can be had, only for use by signalSecure */
+int writeBackSecure(struct writeBack* writers);
+
+/* whether "word" is queued or being written, leaving it where it is */
+int writeBackHolds(struct writeBack* writers, char* word);
+
+/* once set, all writes are made synchronously, as the process is dying */
+int writeBackHalted = 0;
+#endif /* WRITERCOUNT > 0 */
 /* begin definitions */
 LEXICON* lexOpen(const char* lexName, const char* flags){
 	LEXICON* output = calloc(1, sizeof(LEXICON));
@@ -148,22 +487,42 @@ LEXICON* lexOpen(const char* lexName, const char* flags){
 	char* r = strstr(flags, "r");
 	char* w = strstr(flags, "w");
 	char* x = strstr(flags, "x");
+	char* t = strstr(flags, "t");
 	struct stat st = {0};
 	
+	/* record the name of the lexicon */
+	strcpy(output->lexName, lexName);
 	
 	if(w){
 		/* if set to write, we check and create if necessary, the lexicon */
 		if (stat(lexName, &st) == -1) {
 			mkdir(lexName, 0777);
 		}
+		/* a lexicon of other dimensions would be corrupted by our writes */
+		if(lexHeaderCheck(lexName, 1)){
+			free(output);
+			return NULL;
+		}
 		/* flag for writing*/
 		output->flags |= WRITEFLAG;
+		#if LEXPOOL
+		output->pool = densePoolOpen();
+		#endif /* LEXPOOL */
+		#if WRITERCOUNT > 0
+		/* evicted vectors will be written in the background */
+		output->writers = writeBackOpen(output->lexName, &output->stats, output->pool);
+		#endif /* WRITERCOUNT > 0 */
 	}else if(r){
 		/* if set to read and not write, return null if lexicon does not exist */
 		if (stat(lexName, &st) == -1) {
 			free(output);
 			return NULL;
-		}	
+		}
+		/* or if its vectors could not be read correctly */
+		if(lexHeaderCheck(lexName, 0)){
+			free(output);
+			return NULL;
+		}
 		/* flag for reading */
 		output->flags |= READFLAG;
 	}
@@ -172,8 +531,19 @@ LEXICON* lexOpen(const char* lexName, const char* flags){
 		/* flag inclusive (will return unknown words as 0 vector */
 		output->flags |= INCFLAG;
 	}
-	/* record the name of the lexicon */
-	strcpy(output->lexName, lexName);
+	if(t){
+		/* flag tracked (pulled vectors maintain their magnitude and saturation) */
+		output->flags |= TRACKFLAG;
+	}
+	#if LEXPOOL
+	if(!output->pool){
+		output->pool = densePoolOpen();
+	}
+	#endif /* LEXPOOL */
+	#if LEXFILTER > 0
+	/* a lexicon whose directory cannot be listed simply goes without */
+	output->filter = filterOpen(lexName, LEXFILTER == 2);
+	#endif /* LEXFILTER > 0 */
 	
 	#if CACHESIZE > 0
 	output->cache = calloc(CACHESIZE, sizeof(denseRIV*));
@@ -181,7 +551,7 @@ LEXICON* lexOpen(const char* lexName, const char* flags){
 
 	#ifdef SORTCACHE
 	/* a sorted cache needs a search tree for finding RIVs by name */
-	output->treeRoot = calloc(1, sizeof(RIVtree));
+	output->treeRoot = treeCreate(CACHESIZE);
 	output->cacheSaturation = 0;
 	output->cache_slider = output->cache+CACHESIZE;
 	#endif /* SORTCACHE */
@@ -192,6 +562,9 @@ LEXICON* lexOpen(const char* lexName, const char* flags){
 		/* setup cache-list element for break dumping */
 		struct cacheList* newCache = calloc(1, sizeof(struct cacheList));
 		newCache->cache = output->cache;
+		#if WRITERCOUNT > 0
+		newCache->writers = output->writers;
+		#endif /* WRITERCOUNT > 0 */
 		if(!rootCache){
 			rootCache = calloc(1, sizeof(struct cacheList));
 		}
@@ -214,11 +587,87 @@ LEXICON* lexOpen(const char* lexName, const char* flags){
 
 	return output;
 }
+int lexHeaderRead(const char* lexName, struct lexHeader* output){
+	char pathString[200];
+	sprintf(pathString, "%s/%s", lexName, LEXHEADER);
+	FILE* header = fopen(pathString, "r");
+	if(!header){
+		return 1;
+	}
+	/* one "key value" pair to a line, in any order */
+	memset(output, 0, sizeof(struct lexHeader));
+	char key[32];
+	int value;
+	while(fscanf(header, "%31s %d", key, &value) == 2){
+		if(!strcmp(key, "rivsize")){
+			output->rivSize = value;
+		}else if(!strcmp(key, "nonzeros")){
+			output->nonZeros = value;
+		}else if(!strcmp(key, "generator")){
+			output->generator = value;
+		}
+	}
+	fclose(header);
+	if(!output->rivSize || !output->nonZeros || !output->generator){
+		return 2;
+	}
+	return 0;
+}
+int lexHeaderWrite(const char* lexName){
+	char pathString[200];
+	sprintf(pathString, "%s/%s", lexName, LEXHEADER);
+	FILE* header = fopen(pathString, "w");
+	if(!header){
+		return 1;
+	}
+	fprintf(header, "rivsize %d\nnonzeros %d\ngenerator %d\n", RIVSIZE, NONZEROS, RIVGENERATOR);
+	return fclose(header) != 0;
+}
+int lexHeaderCheck(const char* lexName, int writing){
+	struct lexHeader header;
+	int status = lexHeaderRead(lexName, &header);
+	if(status == 2){
+		fprintf(stderr, "lexicon %s has a malformed %s\n", lexName, LEXHEADER);
+		return 1;
+	}
+	if(status == 1){
+		if(!writing){
+			return 0;
+		}
+		/* only an empty lexicon is known to be ours */
+		DIR* directory = opendir(lexName);
+		if(!directory){
+			return 0;
+		}
+		struct dirent* files;
+		int empty = 1;
+		while((files = readdir(directory))){
+			if(*(files->d_name) != '.'){
+				empty = 0;
+				break;
+			}
+		}
+		closedir(directory);
+		if(empty && lexHeaderWrite(lexName)){
+			fprintf(stderr, "could not write the header of lexicon %s\n", lexName);
+		}
+		return 0;
+	}
+	if(header.rivSize != RIVSIZE || header.nonZeros != NONZEROS || header.generator != RIVGENERATOR){
+		fprintf(stderr, "lexicon %s was built with RIVSIZE %d, NONZEROS %d and barcode generator %d,"
+			" but this program was compiled with RIVSIZE %d, NONZEROS %d and barcode generator %d."
+			" rebuild it with -DRIVSIZE=%d -DNONZEROS=%d to use this lexicon\n",
+			lexName, header.rivSize, header.nonZeros, header.generator,
+			RIVSIZE, NONZEROS, RIVGENERATOR, header.rivSize, header.nonZeros);
+		return 1;
+	}
+	return 0;
+}
 void lexClose(LEXICON* toClose){
+	lexPrefetchClose(toClose);
 	
 #if CACHESIZE>0 
 	if(toClose->flags & WRITEFLAG){
-		puts("about to do the dump");
 		if(cacheDump(toClose->cache)){
 			puts("cache dump failed, some lexicon data was lost");
 		}
@@ -240,16 +689,32 @@ void lexClose(LEXICON* toClose){
 		denseRIV* *cache = toClose->cache;
 		for(int i=0; i<CACHESIZE; i++){
 			if(cache[i]){
-				free(cache[i]);
+				densePoolRelease(toClose->pool, cache[i], NULL, 0);
 			}
 		}
 	}
 	//free(toClose->cache);
 	#ifdef SORTCACHE
-	//destroyTree(toClose->treeRoot);
+	destroyTree(toClose->treeRoot);
 	
 	#endif /* SORTCACHE */
 #endif
+	#if WRITERCOUNT > 0
+	/* the dump has only queued the cache, wait for it to reach the disk */
+	if(toClose->writers && writeBackClose(toClose->writers)){
+		puts("background write failed, some lexicon data was lost");
+	}
+	#endif /* WRITERCOUNT > 0 */
+	if(toClose->statsOutput){
+		lexStatsPrint(toClose, toClose->statsOutput);
+	}
+	/* only once every vector has been written */
+	if(toClose->pool){
+		densePoolClose(toClose->pool);
+	}
+	if(toClose->filter){
+		filterClose(toClose->filter);
+	}
 	free(toClose);
 }
 
@@ -298,7 +763,8 @@ int cacheCheckOnPush(LEXICON* lexicon, denseRIV* RIVout){
 	}
 	if(RIVout->frequency > lexicon->cache[hash]->frequency ){
 		/* push the lower frequency cache entry to a file */
-		fLexPush(lexicon, lexicon->cache[hash]);
+		STATSADD(&lexicon->stats, evictions, 1);
+		lexWriteBack(lexicon, lexicon->cache[hash]);
 		/* replace this cache-slot with the current vector */
 
 		lexicon->cache[hash] = RIVout;
@@ -340,7 +806,8 @@ int cacheCheckOnPush(LEXICON* lexicon, denseRIV* RIVout){
 					return 0;
 				}else{
 					treecut(lexicon->treeRoot, toCheck->name);
-					fLexPush(lexicon, toCheck);
+					STATSADD(&lexicon->stats, evictions, 1);
+					lexWriteBack(lexicon, toCheck);
 					treeInsert(lexicon->treeRoot, RIVout->name, RIVout);
 					return 1;
 				}
@@ -356,60 +823,419 @@ int cacheCheckOnPush(LEXICON* lexicon, denseRIV* RIVout){
 
 #endif
 denseRIV* lexPull(LEXICON* lexicon, char* word){
+	unsigned long long start = STATSCLOCK();
+	STATSADD(&lexicon->stats, pulls, 1);
 	
+	/* a read ahead is only good for this one pull, and is taken either way */
+	struct asyncRead* ahead = lexPrefetchTake(lexicon, word);
+	/* first from memory, if the word is cached or waiting to be written */
+	denseRIV* output = lexPullHeld(lexicon, word);
+	if(output){
+		if(ahead){
+			asyncWait(lexicon->reader, ahead);
+			asyncReadFree(ahead);
+		}
+	}else if(ahead){
+		output = lexPullAhead(lexicon, word, ahead);
+	}else if(!lexMayHold(lexicon, word)){
+		/* a word without a file is new, or refused, with nothing opened */
+		output = lexPullFile(lexicon, word, NULL, STATSCLOCK());
+	}else{
+		/* if not, attempt to pull the word data from lexicon file */
+		char pathString[200];
+		
+		sprintf(pathString, "%s/%s", lexicon->lexName, word);
+		
+		unsigned long long readStart = STATSCLOCK();
+		TRACESTART(readSpan, "lexRead");
+		FILE *lexWord = fopen(pathString, "rb");
+		STATSADD(&lexicon->stats, fileOpens, 1);
+		output = lexPullFile(lexicon, word, lexWord, readStart);
+		TRACESTOP(readSpan);
+	}
+	STATSADD(&lexicon->stats, pullTime, STATSCLOCK()-start);
+	return output;
+}
+void lexRelease(LEXICON* lexicon, denseRIV* vector){
+	/* a cached vector stays where it is, as lexPush would leave it */
+	if(vector->cached == lexicon){
+		return;
+	}
+	densePoolRelease(lexicon->pool, vector, NULL, 0);
+}
+denseRIV* lexPullHeld(LEXICON* lexicon, char* word){
 	denseRIV* output = NULL;
 	
 	#if CACHESIZE > 0
 	if(lexicon->flags & CACHEFLAG){
 		/* if there is a cache, first check if the word is cached */
 		if((output = cacheCheckOnPull(lexicon, word))){
+			STATSADD(&lexicon->stats, cacheHits, 1);
 			return output;
 		}
 	}
 	#endif /* CACHESIZE > 0 */
-
-	/* if not, attempt to pull the word data from lexicon file */
-	char pathString[200];
-
-	sprintf(pathString, "%s/%s", lexicon->lexName, word);
-
-	FILE *lexWord = fopen(pathString, "rb");
-
+	
+	#if WRITERCOUNT > 0
+	/* a word waiting to be written is more current than its file */
+	if(lexicon->writers){
+		if((output = writeBackReclaim(lexicon->writers, word))){
+			STATSADD(&lexicon->stats, writerHits, 1);
+			return output;
+		}
+	}
+	#endif /* WRITERCOUNT > 0 */
+	return output;
+}
+denseRIV* lexPullFile(LEXICON* lexicon, char* word, FILE* lexWord, unsigned long long readStart){
+	denseRIV* output;
 	/* if this lexicon file already exists */
 	if(lexWord){
 		/* pull data from file */
 		
-		output = fLexPull(lexWord);
+		output = fLexPullPooled(lexWord, lexicon->pool);
 		if(!output){
+			fclose(lexWord);
 			return NULL;
 		}
 		/* record the "name" of the vector, as the word */
 		strcpy(output->name, word);
+		/* fLexPull tracks the vectors it reads sparse, as that is nearly free */
+		if(!(lexicon->flags & TRACKFLAG)){
+			output->tracked = 0;
+		}else if(!output->tracked){
+			denseTrack(output);
+		}
+		#if LEXSTATS
+		STATSADD(&lexicon->stats, bytesRead, ftell(lexWord));
+		#endif /* LEXSTATS */
 		fclose(lexWord);
+		STATSADD(&lexicon->stats, fileHits, 1);
+		STATSADD(&lexicon->stats, readTime, STATSCLOCK()-readStart);
 	}else{
 		/* if lexicon is set to inclusive (can gain new words) */
 		if(lexicon->flags & INCFLAG){
 			
 			/*if file does not exist, return a 0 vector (word is new to the lexicon) */
-			output = calloc(1, sizeof(denseRIV));
+			output = densePoolAllocate(lexicon->pool, 1);
 			/* record the "name" of the vector, as the word */
 			strcpy(output->name, word);
+			/* a 0 vector's sums are already correct */
+			output->tracked = (lexicon->flags & TRACKFLAG) != 0;
+			STATSADD(&lexicon->stats, newWords, 1);
 		}else{
 			/*if lexicon is set to exclusive, will return a NULL pointer instead of a 0 vector */
+			STATSADD(&lexicon->stats, refusals, 1);
 			return NULL;
 		}
 		
 	}
 	return output;
 }
-
+sparseRIV* lexPullSparse(LEXICON* lexicon, char* word){
+	unsigned long long start = STATSCLOCK();
+	sparseRIV* output = NULL;
+	
+	if(lexHolds(lexicon, word)){
+		/* a word in memory is more current than its file, and is already dense */
+		denseRIV* held = lexPull(lexicon, word);
+		output = consolidateD2S(held->values);
+		if(output){
+			output->frequency = held->frequency;
+			output->contextSize = held->contextSize;
+			output->magnitude = held->magnitude;
+		}
+		lexPush(lexicon, held);
+	}else{
+		STATSADD(&lexicon->stats, pulls, 1);
+		unsigned long long readStart = STATSCLOCK();
+		struct asyncRead* ahead = lexPrefetchTake(lexicon, word);
+		FILE* lexWord = NULL;
+		/* whether the word has no file, rather than one which cannot be read */
+		int missing = 1;
+		if(ahead){
+			asyncWait(lexicon->reader, ahead);
+			STATSADD(&lexicon->stats, prefetchHits, 1);
+			if(!ahead->error){
+				/* an empty file is a failed read, as it is for lexPull */
+				missing = 0;
+				if(ahead->length){
+					lexWord = fmemopen(ahead->data, ahead->length, "rb");
+				}
+			}else if(ahead->error && ahead->error != ENOENT){
+				/* any other failure is left to an ordinary read */
+				char pathString[200];
+				sprintf(pathString, "%s/%s", lexicon->lexName, word);
+				STATSADD(&lexicon->stats, fileOpens, 1);
+				lexWord = fopen(pathString, "rb");
+			}
+		}else if(lexMayHold(lexicon, word)){
+			char pathString[200];
+			sprintf(pathString, "%s/%s", lexicon->lexName, word);
+			STATSADD(&lexicon->stats, fileOpens, 1);
+			lexWord = fopen(pathString, "rb");
+		}
+		
+		if(lexWord){
+			output = fLexPullSparse(lexWord);
+			#if LEXSTATS
+			STATSADD(&lexicon->stats, bytesRead, ftell(lexWord));
+			#endif /* LEXSTATS */
+			fclose(lexWord);
+			if(output){
+				STATSADD(&lexicon->stats, fileHits, 1);
+				STATSADD(&lexicon->stats, readTime, STATSCLOCK()-readStart);
+			}
+		}else if(missing && (lexicon->flags & INCFLAG)){
+			/* a word new to the lexicon is a 0 vector */
+			output = sparseAllocate(0);
+			output->frequency = 0;
+			output->contextSize = 0;
+			output->magnitude = 0;
+			STATSADD(&lexicon->stats, newWords, 1);
+		}else if(missing){
+			STATSADD(&lexicon->stats, refusals, 1);
+		}
+		if(ahead){
+			asyncReadFree(ahead);
+		}
+		STATSADD(&lexicon->stats, pullTime, STATSCLOCK()-start);
+	}
+	if(output){
+		strcpy(output->name, word);
+	}
+	return output;
+}
+int lexPullMany(LEXICON* lexicon, char** words, int wordCount, denseRIV** output){
+	unsigned long long start = STATSCLOCK();
+	/* firsts[i] is where words[i] first appears, which alone is pulled */
+	int* firsts = malloc(wordCount*sizeof(int));
+	RIVtree* seen = treeCreate(wordCount);
+	struct lexPending pending[LEXPULLBATCH];
+	int pendingCount = 0;
+	int distinct = 0;
+	char pathString[200];
+	
+	for(int i=0; i<wordCount; i++){
+		void* first = treeSearch(seen, words[i]);
+		if(first){
+			firsts[i] = (int)(intptr_t)first-1;
+			continue;
+		}
+		/* stored off by one, so that the first word is not NULL */
+		treePlace(seen, words[i], (void*)(intptr_t)(i+1), 0);
+		firsts[i] = i;
+		distinct++;
+		STATSADD(&lexicon->stats, pulls, 1);
+		
+		struct asyncRead* ahead = lexPrefetchTake(lexicon, words[i]);
+		if((output[i] = lexPullHeld(lexicon, words[i]))){
+			if(ahead){
+				asyncWait(lexicon->reader, ahead);
+				asyncReadFree(ahead);
+			}
+			continue;
+		}
+		if(ahead){
+			output[i] = lexPullAhead(lexicon, words[i], ahead);
+			continue;
+		}
+		if(!lexMayHold(lexicon, words[i])){
+			output[i] = lexPullFile(lexicon, words[i], NULL, STATSCLOCK());
+			continue;
+		}
+		sprintf(pathString, "%s/%s", lexicon->lexName, words[i]);
+		unsigned long long opened = STATSCLOCK();
+		int fd = open(pathString, O_RDONLY);
+		STATSADD(&lexicon->stats, fileOpens, 1);
+		if(fd < 0){
+			/* a new word, or one refused */
+			output[i] = lexPullFile(lexicon, words[i], NULL, opened);
+			continue;
+		}
+		/* the kernel may fetch every file of the batch while the first is read */
+		posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+		struct stat st;
+		fstat(fd, &st);
+		pending[pendingCount].index = i;
+		pending[pendingCount].fd = fd;
+		pending[pendingCount].inode = st.st_ino;
+		pending[pendingCount].opened = opened;
+		if(++pendingCount == LEXPULLBATCH){
+			lexPullPending(lexicon, words, pending, pendingCount, output);
+			pendingCount = 0;
+		}
+	}
+	lexPullPending(lexicon, words, pending, pendingCount, output);
+	destroyTree(seen);
+	
+	/* repeats share the vector of their first appearance */
+	for(int i=0; i<wordCount; i++){
+		output[i] = output[firsts[i]];
+	}
+	free(firsts);
+	STATSADD(&lexicon->stats, pullTime, STATSCLOCK()-start);
+	return distinct;
+}
+int lexHolds(LEXICON* lexicon, char* word){
+	#if CACHESIZE > 0
+	if((lexicon->flags & CACHEFLAG) && cacheCheckOnPull(lexicon, word)){
+		return 1;
+	}
+	#endif /* CACHESIZE > 0 */
+	#if WRITERCOUNT > 0
+	if(lexicon->writers && writeBackHolds(lexicon->writers, word)){
+		return 1;
+	}
+	#endif /* WRITERCOUNT > 0 */
+	return 0;
+}
+int lexMayHold(LEXICON* lexicon, char* word){
+	if(!lexicon->filter || filterMayHold(lexicon->filter, word)){
+		return 1;
+	}
+	STATSADD(&lexicon->stats, filterSkips, 1);
+	return 0;
+}
+int lexPrefetch(LEXICON* lexicon, char** words, int wordCount){
+	if(!lexicon->reader){
+		lexicon->reader = asyncOpen();
+		lexicon->ahead = treeCreate(0);
+	}
+	int started = 0;
+	for(int i=0; i<wordCount; i++){
+		/* a word not held now can only come into memory through a pull,
+		 * which takes its read.  so until then, no write can change its file */
+		if(treeSearch(lexicon->ahead, words[i]) || lexHolds(lexicon, words[i])){
+			continue;
+		}
+		/* nor is there anything to read for a word without a file */
+		if(lexicon->filter && !filterMayHold(lexicon->filter, words[i])){
+			continue;
+		}
+		struct asyncRead* read = calloc(1, sizeof(struct asyncRead));
+		snprintf(read->path, sizeof(read->path), "%s/%s", lexicon->lexName, words[i]);
+		asyncSubmit(lexicon->reader, read);
+		treeInsert(lexicon->ahead, words[i], read);
+		started++;
+	}
+	STATSADD(&lexicon->stats, prefetches, started);
+	STATSADD(&lexicon->stats, fileOpens, started);
+	return started;
+}
+struct asyncRead* lexPrefetchTake(LEXICON* lexicon, char* word){
+	if(!lexicon->ahead){
+		return NULL;
+	}
+	struct asyncRead* read = treeSearch(lexicon->ahead, word);
+	if(read){
+		treecut(lexicon->ahead, word);
+	}
+	return read;
+}
+denseRIV* lexPullAhead(LEXICON* lexicon, char* word, struct asyncRead* ahead){
+	unsigned long long readStart = STATSCLOCK();
+	TRACESTART(waitSpan, "prefetchWait");
+	asyncWait(lexicon->reader, ahead);
+	TRACESTOP(waitSpan);
+	STATSADD(&lexicon->stats, prefetchHits, 1);
+	denseRIV* output;
+	if(ahead->error == ENOENT){
+		/* a new word */
+		output = lexPullFile(lexicon, word, NULL, readStart);
+	}else if(ahead->error){
+		/* any other failure is left to an ordinary read */
+		char pathString[200];
+		sprintf(pathString, "%s/%s", lexicon->lexName, word);
+		STATSADD(&lexicon->stats, fileOpens, 1);
+		output = lexPullFile(lexicon, word, fopen(pathString, "rb"), readStart);
+	}else{
+		/* the file is parsed from memory just as it would be from disk */
+		FILE* lexWord = ahead->length? fmemopen(ahead->data, ahead->length, "rb"): NULL;
+		output = lexWord? lexPullFile(lexicon, word, lexWord, readStart): NULL;
+	}
+	asyncReadFree(ahead);
+	return output;
+}
+void lexPrefetchClose(LEXICON* lexicon){
+	if(!lexicon->reader){
+		return;
+	}
+	RIVtree* ahead = lexicon->ahead;
+	for(size_t i=0; i<ahead->capacity; i++){
+		/* every slot whose control byte is not empty or deleted holds a read */
+		if(ahead->control[i] & TREEEMPTY) continue;
+		struct asyncRead* read = ahead->slots[i].data;
+		asyncWait(lexicon->reader, read);
+		asyncReadFree(read);
+	}
+	destroyTree(ahead);
+	asyncClose(lexicon->reader);
+	lexicon->reader = NULL;
+	lexicon->ahead = NULL;
+}
+int lexPendingCompare(const void* a, const void* b){
+	ino_t first = ((struct lexPending*)a)->inode;
+	ino_t second = ((struct lexPending*)b)->inode;
+	return (first > second)-(first < second);
+}
+void lexPullPending(LEXICON* lexicon, char** words, struct lexPending* pending, int pendingCount, denseRIV** output){
+	/* files made one after another lie near each other on disk, and their
+	 * inodes are numbered in much the same order */
+	qsort(pending, pendingCount, sizeof(struct lexPending), lexPendingCompare);
+	for(int i=0; i<pendingCount; i++){
+		TRACESTART(readSpan, "lexRead");
+		int index = pending[i].index;
+		FILE* lexWord = fdopen(pending[i].fd, "rb");
+		if(!lexWord){
+			close(pending[i].fd);
+			output[index] = NULL;
+		}else{
+			output[index] = lexPullFile(lexicon, words[index], lexWord, pending[i].opened);
+		}
+		TRACESTOP(readSpan);
+	}
+}
+int lexPushMany(LEXICON* lexicon, denseRIV** vectors, int count){
+	/* the distinct vectors, and whether each is in the cache, are found
+	 * before any is pushed, as pushing one may evict and free another */
+	denseRIV** distinct = malloc(count*sizeof(denseRIV*));
+	char* held = malloc(count);
+	int distinctCount = 0;
+	RIVtree* seen = treeCreate(count);
+	for(int i=0; i<count; i++){
+		if(!vectors[i] || treeSearch(seen, vectors[i]->name)) continue;
+		treePlace(seen, vectors[i]->name, vectors[i], 0);
+		held[distinctCount] = vectors[i]->cached == lexicon;
+		distinct[distinctCount++] = vectors[i];
+	}
+	destroyTree(seen);
+	
+	int failures = 0;
+	/* cached vectors are already where they belong, so they go first, before
+	 * the others can push them out */
+	for(int i=0; i<distinctCount; i++){
+		if(held[i]) failures += lexPush(lexicon, distinct[i]) != 0;
+	}
+	for(int i=0; i<distinctCount; i++){
+		if(!held[i]) failures += lexPush(lexicon, distinct[i]) != 0;
+	}
+	free(distinct);
+	free(held);
+	return failures;
+}
 int lexPush(LEXICON* lexicon, denseRIV* RIVout){
+	unsigned long long start = STATSCLOCK();
+	STATSADD(&lexicon->stats, pushes, 1);
+	int flag = 0;
 	
 	#if CACHESIZE > 0
 	if(lexicon->flags & CACHEFLAG){
 	/* check the cache to see if it belongs in cache */
 		if(cacheCheckOnPush(lexicon, RIVout)){
 			/* if the cache check returns 1, it has been dealt with in cache */
+			STATSADD(&lexicon->stats, cacheStores, 1);
+			STATSADD(&lexicon->stats, pushTime, STATSCLOCK()-start);
 			return 0;
 		}
 	}
@@ -418,22 +1244,22 @@ int lexPush(LEXICON* lexicon, denseRIV* RIVout){
 	
 	if(lexicon->flags & WRITEFLAG){
 		/* push to the lexicon */
-		return fLexPush(lexicon, RIVout);
+		flag = lexWriteBack(lexicon, RIVout);
 	}else{
 		/* free and return */
-		free(RIVout);
-		return 0;
+		densePoolRelease(lexicon->pool, RIVout, NULL, 0);
 	}
-	
+	STATSADD(&lexicon->stats, pushTime, STATSCLOCK()-start);
+	return flag;
 }
 
-int saturationForStaging(denseRIV* output){
+int saturationForStaging(denseRIV* output, int* stagingSlot){
 	
-	/* IOstagingSlot is a reserved block of stack memory used for this (and other)
+	/* the stagingSlot is a reserved block of memory used for this (and other)
 	 * purposes. in this function, all of the metadata to be written along with a
-	 * sparse representation of the vector, will be laid into the IOstagingSlot
+	 * sparse representation of the vector, will be laid into the stagingSlot
 	 * in the necessary format for writing and reading again */	
-	int* count = IOstagingSlot;
+	int* count = stagingSlot;
 	/* count, requires an 8 byte slot for reasons of compatibility between 
 	 * dense and sparse. it takes up two integers (int* count and count+1); */
 	*count = 0;
@@ -444,12 +1270,12 @@ int saturationForStaging(denseRIV* output){
 	*(float*)(count+4) = output->magnitude;
 	
 	/* locations will be laid in immediately after the metadata */
-	int* locations = IOstagingSlot+5;
+	int* locations = stagingSlot+5;
 	/* values will be laid in *before* metadata, to be copied after locations,
 	 * once the size of the values and locations arrays are known.  there is,
 	 * by description of the stagingSlot, enough room for a 
 	 * completely saturated vector without conflict */
-	int* values = IOstagingSlot-RIVSIZE;;
+	int* values = stagingSlot-RIVSIZE;;
 	int* locations_slider = locations;
 	int* values_slider = values;
 	for(int i=0; i<RIVSIZE; i++){
@@ -474,59 +1300,358 @@ int saturationForStaging(denseRIV* output){
 	/* return number of non-zeros */
 	return *count;
 }
-int fLexPush(LEXICON* lexicon, denseRIV* output){	
+
+int stageForWrite(denseRIV* output, int* stagingSlot){
+	/* a tracked vector already knows it is to be written dense, and needs
+	 * no sparse layout at all */
+	if(output->tracked && output->nonZeros >= RIVSIZE/2){
+		stagingSlot[0] = 0;
+		stagingSlot[1] = 0;
+		stagingSlot[2] = output->frequency;
+		stagingSlot[3] = output->contextSize;
+		*(float*)(stagingSlot+4) = output->magnitude;
+		memcpy(stagingSlot+5, output->values, RIVSIZE*sizeof(int));
+		return RIVSIZE+5;
+	}
+	/* saturationForStaging returns the number of non-zero elements in the vector
+	 * and, in the process, places the data of the vector, in sparse format, in the
+	 * stagingSlot */
+	int saturation = saturationForStaging(output, stagingSlot);
+	
+	/* if our vector is less than half full, it is lighter to save it as a sparseRIV */
+	if( saturation < RIVSIZE/2){
+		return (saturation*2)+5;
+	}
+	/* otherwise it is laid out as a dense vector: a typecheck flag (0) for
+	 * the fLexPull function to know that this is a denseVector, the metadata
+	 * (already in place) and then every value */
+	stagingSlot[0] = 0;
+	stagingSlot[1] = 0;
+	memcpy(stagingSlot+5, output->values, RIVSIZE*sizeof(int));
+	return RIVSIZE+5;
+}
+
+int writeStaged(const char* lexName, const char* name, int* stagingSlot, int intCount){
 	char pathString[200] = {0};
 	
 	/* word data will be placed in a (new?) file under the lexicon directory
 	 * in a file named after the word itself */
-	sprintf(pathString, "%s/%s", lexicon->lexName, output->name);
+	sprintf(pathString, "%s/%s", lexName, name);
 	
-	/* saturationForStaging returns the number of non-zero elements in the vector
-	 * and, in the process, places the data of the vector, in sparse format, in the
-	 * preallocated "IOstagingSlot" */
-	int saturation = saturationForStaging(output);
+	FILE *lexWord = fopen(pathString, "wb");
+	if(!lexWord){
+		fprintf(stderr,"lexicon push has failed for word: %s\n", name);
+		return 1;
+	}
+	/* the stagingSlot is formatted for immediate writing */
+	fwrite(stagingSlot, intCount, sizeof(int), lexWord);
+	fclose(lexWord);
+	return 0;
+}
+
+int fLexPush(LEXICON* lexicon, denseRIV* output){	
+	unsigned long long start = STATSCLOCK();
+	TRACESTART(writeSpan, "lexWrite");
 	
-	/* if our vector is less than half full, it is lighter to save it as a sparseRIV */
-	if( saturation < RIVSIZE/2){
-		
-		FILE *lexWord = fopen(pathString, "wb");
-		if(!lexWord){
-			fprintf(stderr,"lexicon push has failed for word: %s\n", output->name);
-			return 1;
+	int intCount = stageForWrite(output, IOstagingSlot);
+	
+	/* the word has a file from now on (a failed write leaves the filter
+	 * saying only that it may have) */
+	if(lexicon->filter){
+		filterAdd(lexicon->filter, output->name);
+	}
+	int failed = writeStaged(lexicon->lexName, output->name, IOstagingSlot, intCount);
+	statsCountWrite(&lexicon->stats, intCount, failed, STATSCLOCK()-start);
+	TRACESTOP(writeSpan);
+	if(failed){
+		return 1;
+	}
+	/* and free the memory. a vector written sparse has its non-zeros staged,
+	 * and only those need be cleared for its buffer to be used again */
+	int sparse = intCount != RIVSIZE+5;
+	densePoolRelease(lexicon->pool, output, sparse? IOstagingSlot+5: NULL, sparse? (intCount-5)/2: 0);
+
+	return 0;
+}
+
+void statsCountWrite(struct lexStats* stats, int intCount, int failed, unsigned long long time){
+	#if LEXSTATS
+	STATSADD(stats, fileOpens, 1);
+	if(failed){
+		STATSADD(stats, writeFailures, 1);
+	}else{
+		STATSADD(stats, bytesWritten, intCount*sizeof(int));
+		/* only a dense vector is staged at full size */
+		if(intCount == RIVSIZE+5){
+			STATSADD(stats, denseWrites, 1);
+		}else{
+			STATSADD(stats, sparseWrites, 1);
 		}
-		/* IOstagingSlot is formatted for immediate writing */
-		fwrite(IOstagingSlot, (saturation*2)+5, sizeof(int), lexWord);
-		fclose(lexWord);
+	}
+	STATSADD(stats, writeTime, time);
+	#endif /* LEXSTATS */
+}
+
+unsigned long long statsClock(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000ULL+now.tv_nsec;
+}
+
+void lexStatsGet(LEXICON* lexicon, struct lexStats* output){
+	/* field by field, as writers may be updating them */
+	unsigned long long* fields = (unsigned long long*)&lexicon->stats;
+	unsigned long long* outputFields = (unsigned long long*)output;
+	for(size_t i=0; i<sizeof(struct lexStats)/sizeof(unsigned long long); i++){
+		outputFields[i] = __atomic_load_n(fields+i, __ATOMIC_RELAXED);
+	}
+}
+
+void lexStatsPrint(LEXICON* lexicon, FILE* output){
+	struct lexStats stats;
+	lexStatsGet(lexicon, &stats);
+	fprintf(output, "{\"lexicon\": \"%s\", \"pulls\": %llu, \"cacheHits\": %llu, \"writerHits\": %llu, "
+		"\"fileHits\": %llu, \"newWords\": %llu, \"refusals\": %llu, \"filterSkips\": %llu, "
+		"\"prefetches\": %llu, \"prefetchHits\": %llu, ",
+		lexicon->lexName, stats.pulls, stats.cacheHits, stats.writerHits,
+		stats.fileHits, stats.newWords, stats.refusals, stats.filterSkips,
+		stats.prefetches, stats.prefetchHits);
+	fprintf(output, "\"pushes\": %llu, \"cacheStores\": %llu, \"evictions\": %llu, "
+		"\"fileOpens\": %llu, \"bytesRead\": %llu, \"bytesWritten\": %llu, "
+		"\"sparseWrites\": %llu, \"denseWrites\": %llu, \"writeFailures\": %llu, ",
+		stats.pushes, stats.cacheStores, stats.evictions,
+		stats.fileOpens, stats.bytesRead, stats.bytesWritten,
+		stats.sparseWrites, stats.denseWrites, stats.writeFailures);
+	fprintf(output, "\"pullSeconds\": %.6f, \"pushSeconds\": %.6f, \"readSeconds\": %.6f, \"writeSeconds\": %.6f}\n",
+		stats.pullTime*1e-9, stats.pushTime*1e-9, stats.readTime*1e-9, stats.writeTime*1e-9);
+	fflush(output);
+}
+
+void lexStatsReport(LEXICON* lexicon, FILE* output){
+	lexicon->statsOutput = output;
+}
+
+int lexWriteBack(LEXICON* lexicon, denseRIV* RIVout){
+	/* a vector evicted from the cache of a lexicon not open for writing is
+	 * dropped, as lexPush would have dropped it */
+	if(!(lexicon->flags & WRITEFLAG)){
+		densePoolRelease(lexicon->pool, RIVout, NULL, 0);
+		return 0;
+	}
+	#if WRITERCOUNT > 0
+	if(lexicon->writers && !writeBackHalted){
+		/* until written, the word is found in its writer's queue, before the
+		 * filter is ever asked */
+		if(lexicon->filter){
+			filterAdd(lexicon->filter, RIVout->name);
+		}
+		writeBackPush(lexicon->writers, RIVout);
+		return 0;
+	}
+	#endif /* WRITERCOUNT > 0 */
+	return fLexPush(lexicon, RIVout);
+}
+
+#if WRITERCOUNT > 0
+struct writeBack* writeBackOpen(const char* lexName, struct lexStats* stats, densePool* pool){
+	struct writeBack* writers = calloc(WRITERCOUNT, sizeof(struct writeBack));
+	for(int i=0; i<WRITERCOUNT; i++){
+		writers[i].lexName = lexName;
+		writers[i].stats = stats;
+		writers[i].pool = pool;
+		pthread_mutex_init(&writers[i].lock, NULL);
+		pthread_cond_init(&writers[i].filled, NULL);
+		pthread_cond_init(&writers[i].drained, NULL);
+		/* each writer needs a private copy of what IOstagingSlot is to fLexPush:
+		 * RIVSIZE integers behind the slot and 2*RIVSIZE+5 ahead of it */
+		writers[i].stagingBlock = malloc((3*RIVSIZE+5)*sizeof(int));
+		pthread_create(&writers[i].thread, NULL, writeBackThread, &writers[i]);
+	}
+	return writers;
+}
+
+int writeBackClose(struct writeBack* writers){
+	int failures = 0;
+	for(int i=0; i<WRITERCOUNT; i++){
+		pthread_mutex_lock(&writers[i].lock);
+		writers[i].closing = 1;
+		pthread_cond_signal(&writers[i].filled);
+		pthread_mutex_unlock(&writers[i].lock);
+	}
+	/* writers only exit once their queues are empty */
+	for(int i=0; i<WRITERCOUNT; i++){
+		pthread_join(writers[i].thread, NULL);
+		failures += writers[i].failures;
+		pthread_mutex_destroy(&writers[i].lock);
+		pthread_cond_destroy(&writers[i].filled);
+		pthread_cond_destroy(&writers[i].drained);
+		free(writers[i].stagingBlock);
+	}
+	free(writers);
+	return failures;
+}
+
+void writeBackPush(struct writeBack* writers, denseRIV* RIVout){
+	/* words are assigned to writers by their seed, so that each word's
+	 * writes happen in the order they were pushed */
+	struct writeBack* writer = writers+((unsigned int)wordtoSeed(RIVout->name))%WRITERCOUNT;
+	
+	pthread_mutex_lock(&writer->lock);
+	/* back-pressure: if this writer is behind, wait for it */
+	while(writer->count == WRITEQUEUESIZE){
+		pthread_cond_wait(&writer->drained, &writer->lock);
+	}
+	writer->queue[(writer->head+writer->count)%WRITEQUEUESIZE] = RIVout;
+	writer->count++;
+	pthread_cond_signal(&writer->filled);
+	pthread_mutex_unlock(&writer->lock);
+}
+
+denseRIV* writeBackReclaim(struct writeBack* writers, char* word){
+	struct writeBack* writer = writers+((unsigned int)wordtoSeed(word))%WRITERCOUNT;
+	denseRIV* output = NULL;
+	
+	pthread_mutex_lock(&writer->lock);
+	/* the vector may already be in the writer's hands.  once it is staged the
+	 * writer no longer reads it, and we can take it back without waiting */
+	while(writer->inFlight && !writer->staged && !strcmp(writer->inFlight->name, word)){
+		pthread_cond_wait(&writer->drained, &writer->lock);
+	}
+	if(writer->inFlight && !writer->reclaimed && !strcmp(writer->inFlight->name, word)){
+		output = writer->inFlight;
+		writer->reclaimed = 1;
 	}else{
-		/* the "cached" datapoint will be erased, a typecheck flag (0) for
-		 * the fLexPull function to know that this is a denseVector put 
-		 * in its place */
-		output->cached = 0;
-		FILE *lexWord = fopen(pathString, "wb");
-		if(!lexWord){
-			fprintf(stderr, "lexicon push has failed for word: %s\n", output->name);
-			return 1;
+		/* or it may still be waiting in the queue */
+		for(int i=0; i<writer->count; i++){
+			int slot = (writer->head+i)%WRITEQUEUESIZE;
+			if(strcmp(writer->queue[slot]->name, word)) continue;
+			
+			output = writer->queue[slot];
+			/* close the gap this leaves in the queue */
+			for(; i<writer->count-1; i++){
+				writer->queue[(writer->head+i)%WRITEQUEUESIZE] = 
+					writer->queue[(writer->head+i+1)%WRITEQUEUESIZE];
+			}
+			writer->count--;
+			pthread_cond_signal(&writer->drained);
+			break;
 		}
-		/* from the type flag forward, all metadata is preformatted, we simpy write */
-		fwrite(((int*)&output->cached), sizeof(int), RIVSIZE+5, lexWord);
-		
-		fclose(lexWord);
 	}
+	pthread_mutex_unlock(&writer->lock);
 	
-	/* and free the memory */
-	free(output);
+	if(output){
+		/* it is no longer cached, and must be handled as a freshly pulled vector */
+		output->cached = NULL;
+	}
+	return output;
+}
 
-	return 0;
+int writeBackHolds(struct writeBack* writers, char* word){
+	struct writeBack* writer = writers+((unsigned int)wordtoSeed(word))%WRITERCOUNT;
+	int held = 0;
+	pthread_mutex_lock(&writer->lock);
+	/* while being written, its file is not yet safe to read */
+	if(writer->inFlight && !strcmp(writer->inFlight->name, word)){
+		held = 1;
+	}
+	for(int i=0; !held && i<writer->count; i++){
+		held = !strcmp(writer->queue[(writer->head+i)%WRITEQUEUESIZE]->name, word);
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return held;
+}
+
+void* writeBackThread(void* writerV){
+	struct writeBack* writer = (struct writeBack*)writerV;
+	int* stagingSlot = writer->stagingBlock+RIVSIZE;
+	
+	pthread_mutex_lock(&writer->lock);
+	while(1){
+		while(!writer->count && !writer->closing){
+			pthread_cond_wait(&writer->filled, &writer->lock);
+		}
+		/* only exit once everything queued has been written */
+		if(!writer->count) break;
+		
+		denseRIV* output = writer->queue[writer->head];
+		writer->head = (writer->head+1)%WRITEQUEUESIZE;
+		writer->count--;
+		writer->inFlight = output;
+		writer->staged = 0;
+		writer->reclaimed = 0;
+		pthread_cond_broadcast(&writer->drained);
+		pthread_mutex_unlock(&writer->lock);
+		
+		/* the full scan and the disk are both paid here, off the hot path */
+		unsigned long long start = STATSCLOCK();
+		TRACESTART(writeSpan, "writeBack");
+		int intCount = stageForWrite(output, stagingSlot);
+		
+		pthread_mutex_lock(&writer->lock);
+		writer->staged = 1;
+		pthread_cond_broadcast(&writer->drained);
+		pthread_mutex_unlock(&writer->lock);
+		
+		int failed = writeStaged(writer->lexName, output->name, stagingSlot, intCount);
+		statsCountWrite(writer->stats, intCount, failed, STATSCLOCK()-start);
+		TRACESTOP(writeSpan);
+		
+		pthread_mutex_lock(&writer->lock);
+		writer->failures += failed;
+		/* if the vector was pulled back while being written, it is not ours to free */
+		if(!writer->reclaimed){
+			int sparse = !failed && intCount != RIVSIZE+5;
+			densePoolRelease(writer->pool, output, sparse? stagingSlot+5: NULL, sparse? (intCount-5)/2: 0);
+		}
+		writer->inFlight = NULL;
+	}
+	pthread_mutex_unlock(&writer->lock);
+	return NULL;
 }
 
+int writeBackSecure(struct writeBack* writers){
+	int flag = 0;
+	for(int i=0; i<WRITERCOUNT; i++){
+		/* the writer may hold its lock, or even be dead. we do what we can */
+		int locked = !pthread_mutex_trylock(&writers[i].lock);
+		/* a vector being written is written again, as its writer may be
+		 * stopped before it finishes.  this is only done with the lock in
+		 * hand: without it, the writer may be giving the vector back at this
+		 * moment, and its values may no longer be whole.  a vector reclaimed
+		 * mid-write is in a cache again, and dumped from there */
+		if(locked && writers[i].inFlight && !writers[i].reclaimed){
+			denseRIV* output = writers[i].inFlight;
+			int intCount = stageForWrite(output, IOstagingSlot);
+			flag += writeStaged(writers[i].lexName, output->name, IOstagingSlot, intCount);
+		}
+		while(writers[i].count){
+			denseRIV* output = writers[i].queue[writers[i].head];
+			int intCount = stageForWrite(output, IOstagingSlot);
+			flag += writeStaged(writers[i].lexName, output->name, IOstagingSlot, intCount);
+			writers[i].head = (writers[i].head+1)%WRITEQUEUESIZE;
+			writers[i].count--;
+		}
+	}
+	return flag;
+}
+#endif /* WRITERCOUNT > 0 */
+
 denseRIV* fLexPull(FILE* lexWord){
-	denseRIV *output = calloc(1,sizeof(denseRIV));
+	return fLexPullPooled(lexWord, NULL);
+}
+denseRIV* fLexPullPooled(FILE* lexWord, densePool* pool){
+	denseRIV *output;
 	size_t typeCheck;
 	/* the first 8 byte value in the file will be either 0 (indicating storage as a dense vector)
 	 * or a positive number, the number of values in a sparse-vector */
 	if(!fread(&typeCheck, 1, sizeof(size_t), lexWord)){
 		return NULL;
 	}
+	/* a vector of more values than dimensions was not written by this build */
+	if(typeCheck > RIVSIZE){
+		printf("vector read failure");
+		return NULL;
+	}
 	
 	/* first value stored is the value count if sparse, and 0 if dense */
 	if (typeCheck){ /* pull as sparseVector */
@@ -544,31 +1669,137 @@ denseRIV* fLexPull(FILE* lexWord){
 			printf("vector read failure");
 			return NULL;
 		}
+		/* nor was one with locations outside of our dimensions */
+		for(size_t i=0; i<typeCheck; i++){
+			if(temp->locations[i] < 0 || temp->locations[i] >= RIVSIZE){
+				printf("vector read failure");
+				return NULL;
+			}
+		}
+		/* only a whole vector is given a buffer, which must start at 0 */
+		if(!(output = densePoolAllocate(pool, 1))){
+			return NULL;
+		}
 		
-		/* add our temporary sparseVector to the empty denseVector, for output */
+		/* add our temporary sparseVector to the empty denseVector, for output.
+		 * tracked, its sums are counted along the way */
+		output->tracked = 1;
 		addRIV(output, temp);
 		output->contextSize = temp->contextSize;
 		output->frequency = temp->frequency;
 		output->magnitude = temp ->magnitude;
 	}else{ /* typecheck is thrown away, just a flag in this case */
-	
+		
+		/* every value will be read over, so the buffer need not be zeroed */
+		if(!(output = densePoolAllocate(pool, 0))){
+			return NULL;
+		}
 		/*  read into our denseVector pre-formatted to fit */
 		if(fread(&output->frequency, sizeof(int), RIVSIZE+3, lexWord) != RIVSIZE+3){
 			printf("vector read failure");
+			densePoolRelease(pool, output, NULL, 0);
+			return NULL;
+		}
+		/* a longer dense vector would otherwise be silently cut short */
+		if(fgetc(lexWord) != EOF){
+			printf("vector read failure");
+			densePoolRelease(pool, output, NULL, 0);
 			return NULL;
 		}
 	}
 
 	return output;
 }
+sparseRIV* fLexPullSparse(FILE* lexWord){
+	size_t typeCheck;
+	/* the first 8 byte value in the file is 0 for a dense vector, or the
+	 * number of values in a sparse vector, just as for fLexPull */
+	if(!fread(&typeCheck, 1, sizeof(size_t), lexWord) || typeCheck > RIVSIZE){
+		return NULL;
+	}
+	sparseRIV* output;
+	if(typeCheck){ /* sparse: the file's layout is the sparseRIV's own, from frequency on */
+		output = sparseAllocate(typeCheck);
+		if(!output) return NULL;
+		if(fread(&output->frequency, sizeof(int), (typeCheck*2)+3, lexWord) != typeCheck*2+3){
+			free(output);
+			return NULL;
+		}
+		for(size_t i=0; i<typeCheck; i++){
+			if(output->locations[i] < 0 || output->locations[i] >= RIVSIZE){
+				free(output);
+				return NULL;
+			}
+		}
+	}else{ /* dense: read whole, then consolidated */
+		int* readSlot = malloc((RIVSIZE+3)*sizeof(int));
+		if(!readSlot) return NULL;
+		if(fread(readSlot, sizeof(int), RIVSIZE+3, lexWord) != RIVSIZE+3 || fgetc(lexWord) != EOF){
+			free(readSlot);
+			return NULL;
+		}
+		output = consolidateD2S(readSlot+3);
+		if(output){
+			/* frequency, contextSize and magnitude, as stored */
+			memcpy(&output->frequency, readSlot, 3*sizeof(int));
+		}
+		free(readSlot);
+	}
+	return output;
+}
+int fLexAdd(FILE* lexWord, denseRIV* output, int* readSlot){
+	size_t typeCheck;
+	int metadata[3];
+	/* the first 8 byte value in the file is 0 for a dense vector, or the
+	 * number of values in a sparse vector, just as for fLexPull */
+	if(!fread(&typeCheck, 1, sizeof(size_t), lexWord)){
+		return 1;
+	}
+	if(typeCheck > RIVSIZE || fread(metadata, sizeof(int), 3, lexWord) != 3){
+		return 1;
+	}
+	if(typeCheck){ /* sparse: locations, followed by values */
+		if(fread(readSlot, sizeof(int), typeCheck*2, lexWord) != typeCheck*2){
+			return 1;
+		}
+		int* locations = readSlot;
+		int* values = readSlot+typeCheck;
+		for(size_t i=0; i<typeCheck; i++){
+			if(locations[i] < 0 || locations[i] >= RIVSIZE) return 1;
+			output->values[locations[i]] += values[i];
+		}
+	}else{ /* dense: every value in order */
+		if(fread(readSlot, sizeof(int), RIVSIZE, lexWord) != RIVSIZE || fgetc(lexWord) != EOF){
+			return 1;
+		}
+		for(int i=0; i<RIVSIZE; i++){
+			output->values[i] += readSlot[i];
+		}
+	}
+	output->frequency += metadata[0];
+	output->contextSize += metadata[1];
+	return 0;
+}
 /* if our data is cached, it cannot be allowed to be lost in event of an issue */
 void signalSecure(int signum, siginfo_t *si, void* arg){
+	#if WRITERCOUNT > 0
+	/* from here on, every write must be finished before we return */
+	writeBackHalted = 1;
+	#endif /* WRITERCOUNT > 0 */
+	/* and no memory is given back, as the pool may be mid-change */
+	densePoolHalted = 1;
 	/* descend linked list */
 	while(rootCache->next){
 		/* dumping all caches contained */
 		if(cacheDump(rootCache->cache)){
 			fprintf(stderr, "cache dump failed, some lexicon data lost");
 		}
+		#if WRITERCOUNT > 0
+		/* as well as anything still waiting to be written */
+		if(rootCache->writers && writeBackSecure(rootCache->writers)){
+			fprintf(stderr, "queued writes failed, some lexicon data lost");
+		}
+		#endif /* WRITERCOUNT > 0 */
 		rootCache = rootCache->next;
 		
 	}
@@ -593,14 +1824,14 @@ int cacheDump(denseRIV* *toDump){
 		/* if our cache is hashed, there may be null vectors to be skipped */
 		if(*toDump_slider){
 			
-			flag += fLexPush((LEXICON*)(*toDump_slider)->cached,*toDump_slider);
+			flag += lexWriteBack((LEXICON*)(*toDump_slider)->cached,*toDump_slider);
 		}
 		#else /* HASHCACHE */
 		#ifdef SORTCACHE
 		/* if our cache is sorted, a null vector represents the end of the cache */
 		if(!*toDump_slider)break;
 			//printf("%d: %s, ", i++, (*toDump_slider)->name);
-		flag += fLexPush((LEXICON*)(*toDump_slider)->cached,*toDump_slider);
+		flag += lexWriteBack((LEXICON*)(*toDump_slider)->cached,*toDump_slider);
 		
 		#endif /* SORTCACHE */
 		#endif
@@ -26,6 +26,13 @@
 #endif
 
 
+/* RIVGENERATOR is the version of the barcode generator, which seeds rand()
+ * with the word (see makeSparseLocations).  it is recorded in every lexicon's
+ * header, and must be raised by any change that gives a word a different
+ * barcode, as vectors built from the old barcodes would no longer match
+ */
+#define RIVGENERATOR 1
+
 /* CACHESIZE macro defines the number of RIVs the system will cache.
  * a larger cache means more memory consumption, but will also be significantly
  * faster in aggregation and reading applications. doesn't affect systems
@@ -68,6 +75,14 @@ typedef struct sparseRIV{
  */
 typedef struct denseRIV{
 	char name[100];
+	/* if "tracked" is set, sumSquares and nonZeros (the sum of the squares of
+	 * the values, and the number which are not 0) are kept up to date through
+	 * addS2D, addD2D and subtractThisWord, so that the magnitude and the
+	 * saturation of the vector are known without a scan. see denseTrack.
+	 * these precede the metadata, which is stored in line with the values */
+	int tracked;
+	int nonZeros;
+	unsigned long long sumSquares;
 	void* cached;
 	int frequency;
 	int contextSize;
@@ -80,10 +95,17 @@ int tempBlock[TEMPSIZE];
 /*consolidateD2S takes a denseRIV value-set input, and returns a sparse RIV with
  * all 0s removed. it does not automatically carry metadata, which must be assigned
  * to a denseRIV after the fact.  often denseRIVs are only temporary, and don't
- * contain any metadata
+ * contain any metadata. it uses no shared memory, so threads may consolidate at once
  */
 sparseRIV* consolidateD2S(int *denseInput);  //#TODO fix int*/denseRIV confusion
 
+/* the same, but leaves denseInput all 0s, ready to accumulate again without
+ * being cleared separately */
+sparseRIV* consolidateD2SClear(int *denseInput);
+
+/* the body of both, clearing denseInput if "clear" is set */
+sparseRIV* consolidateDense(int *denseInput, int clear);
+
 /* makeSparseLocations must be called repeatedly in the processing of a 
  * file to produce a series of locations from the words of the file
  * this produces an "implicit" RIV which can be used with the mapI2D function
@@ -94,10 +116,29 @@ void makeSparseLocations(char* word,  int *seeds, int seedCount);
 /* adds the barcode (L1) vector of a word to a denseVector */
 void addBarcodeToDense(int* base, char* word);
 
+/* the same, for a word given as a span of text (see RIVtokenizer.h) */
+void addBarcodeSpanToDense(int* base, const char* word, size_t length);
+
 /*subtracts a words vector from its own context.  regularly used in lex building
  */
 void subtractThisWord(denseRIV* vector);
 
+/* denseTrack counts the sum of squares and the non-zeros of a denseVector,
+ * and marks it as tracked, so that they are maintained from then on.
+ * a vector changed other than through the tracked functions (addBarcodeToDense,
+ * or writing its values directly) must be tracked again, or untracked
+ */
+void denseTrack(denseRIV* vector);
+
+/* adds "amount" to one value of a denseVector, keeping its tracking */
+static inline void denseTrackedAdd(denseRIV* vector, int location, int amount){
+	long long before = vector->values[location];
+	long long after = before+amount;
+	vector->values[location] = after;
+	vector->sumSquares += after*after-before*before;
+	vector->nonZeros += (after != 0)-(before != 0);
+}
+
 /* begin definitions */
 
 
@@ -111,13 +152,30 @@ sparseRIV* sparseAllocate(int valueCount){
 }
 
 sparseRIV* consolidateD2S(int *denseInput){
+	return consolidateDense(denseInput, 0);
+}
+
+sparseRIV* consolidateD2SClear(int *denseInput){
+	return consolidateDense(denseInput, 1);
+}
+
+sparseRIV* consolidateDense(int *denseInput, int clear){
 	sparseRIV* output;
 	int count = 0;
-	/* key/value pairs will be loaded to a worst-case sized temporary slot */
-	int* locations = tempBlock+RIVSIZE;
-	int* values = locations+RIVSIZE;
-	int* locations_slider = locations;
-	int* values_slider = values;
+	/* the non-zeros are counted first, so that the output can be filled in
+	 * place, rather than staged in a shared temporary slot */
+	for(int i=0; i<RIVSIZE; i++){
+		count += (denseInput[i] != 0);
+	}
+	/* a slot is opened for the locations/values pair */
+	
+	output = sparseAllocate(count);
+	if(!output){
+		printf("memory allocation failed"); //*TODO enable fail point knowledge and security
+		return NULL;
+	}
+	int* locations_slider = output->locations;
+	int* values_slider = output->values;
 	for(int i=0; i<RIVSIZE; i++){
 		
 		/* act only on non-zeros */
@@ -129,21 +187,9 @@ sparseRIV* consolidateD2S(int *denseInput){
 			/* assign value to values */
 			*(values_slider++) = denseInput[i];
 			
-			/* track size of forming sparseRIV */
-			count++;
+			if(clear) denseInput[i] = 0;
 		}
 	}
-	/* a slot is opened for the locations/values pair */
-	
-	output = sparseAllocate(count);
-	if(!output){
-		printf("memory allocation failed"); //*TODO enable fail point knowledge and security
-	}
-	/* copy locations values into opened slot */
-	memcpy(output->locations, locations, output->count*sizeof(int));
-	
-	/* copy values into opened slot */
-	memcpy(output->values, values, output->count*sizeof(int));
 	
 	return output;
 }
@@ -179,9 +225,16 @@ void subtractThisWord(denseRIV* vector){
 	 * +1s and -1s at "random" points (defined by the above seed.
 	 * if we invert it to -1s and +1s, we have subtraction */
 	
-	for(int i = 0; i < NONZEROS; i+= 2){
-		vector->values[rand()%RIVSIZE] -= 1;
-		vector->values[rand()%RIVSIZE] += 1;	
+	if(vector->tracked){
+		for(int i = 0; i < NONZEROS; i+= 2){
+			denseTrackedAdd(vector, rand()%RIVSIZE, -1);
+			denseTrackedAdd(vector, rand()%RIVSIZE, 1);
+		}
+	}else{
+		for(int i = 0; i < NONZEROS; i+= 2){
+			vector->values[rand()%RIVSIZE] -= 1;
+			vector->values[rand()%RIVSIZE] += 1;	
+		}
 	}
 	/* record a context size 1 smaller */
 	vector->contextSize-= 1;
@@ -197,15 +250,35 @@ void subtractThisWordPacked(denseRIV* vector){
 	for(int i=0; i<NONZEROS; i++){
 		value = rand()%2;
 		if(!value) value = -1;
-		vector->values[rand()%RIVSIZE] -= value;
+		if(vector->tracked){
+			denseTrackedAdd(vector, rand()%RIVSIZE, -value);
+		}else{
+			vector->values[rand()%RIVSIZE] -= value;
+		}
 	}
 	/* record a context size 1 smaller */
 	vector->contextSize-= 1;
 	
 }
 
+void denseTrack(denseRIV* vector){
+	unsigned long long sumSquares = 0;
+	int nonZeros = 0;
+	for(int i=0; i<RIVSIZE; i++){
+		long long value = vector->values[i];
+		sumSquares += value*value;
+		nonZeros += value != 0;
+	}
+	vector->sumSquares = sumSquares;
+	vector->nonZeros = nonZeros;
+	vector->tracked = 1;
+}
+
 void addBarcodeToDense(int* base, char* word){
-	srand(wordtoSeed(word));
+	addBarcodeSpanToDense(base, word, strlen(word));
+}
+void addBarcodeSpanToDense(int* base, const char* word, size_t length){
+	srand(spanToSeed(word, length));
 	int value;
 	for(int i=0; i<NONZEROS; i++){
 		value = rand()%2;
@@ -44,7 +44,7 @@ enum RIVTYPES{
 /* calculates the magnitude of a sparseVector */
 double getMagnitudeSparse(void* input);
 
-/* same for denseVector */
+/* same for denseVector. a tracked vector (see denseTrack) needs no scan */
 double getMagnitudeDense(void* input);
 double (*magP[2]) (void* input) = {getMagnitudeSparse,getMagnitudeDense};
 	
@@ -52,6 +52,15 @@ double (*magP[2]) (void* input) = {getMagnitudeSparse,getMagnitudeDense};
 #define RIVMagnitude(vector) \
 	magP[TYPECHECK(vector)](vector)
 
+/* scales "count" values by "multiplier", rounding each to an integer, and
+ * writes those which do not round to 0, with their locations, to the
+ * outputs.  "locations" may be NULL for dense values, whose locations are
+ * their indexes.  the outputs may be the inputs.  if "single" is set the
+ * products are taken in single precision, as normalize has always taken
+ * them.  returns the number of values kept
+ */
+size_t scaleValues(const int* values, const int* locations, size_t count, double multiplier, int single, int* valuesOut, int* locationsOut);
+
 double cosCompareS2S(void* vector1, void* vector2);
 double cosCompareS2D(void* dense, void* sparse);
 double cosCompareD2S(void* sparse, void* dense);
@@ -81,6 +90,15 @@ void addS2D(void* destinationV, void* inputV){
 	int *values_slider = input->values;
 	int *locations_stop = locations_slider+input->count;
 	
+	/* a tracked vector keeps its sum of squares and non-zeros as it goes */
+	if(((denseRIV*)destinationV)->tracked){
+		while(locations_slider<locations_stop){
+			denseTrackedAdd(destinationV, *locations_slider, *values_slider);
+			locations_slider++;
+			values_slider++;
+		}
+		return;
+	}
 	/* apply values at an index based on locations */
 	while(locations_slider<locations_stop){
 		
@@ -97,6 +115,10 @@ void addD2D(void* destinationV, void* inputV){
 	for(int i=0; i<RIVSIZE; i++){	
 		destination[i] += input[i];
 	}
+	/* every value may have changed, so a tracked vector is simply recounted */
+	if(((denseRIV*)destinationV)->tracked){
+		denseTrack(destinationV);
+	}
 	
 }
 void addS2S(void* destinationV, void* inputV){
@@ -137,6 +159,9 @@ void addD2S(void* destinationV, void* inputV){
 }
 
 double getMagnitudeDense(void *inputV){
+	if(((denseRIV*)inputV)->tracked){
+		return sqrt(((denseRIV*)inputV)->sumSquares);
+	}
 	size_t temp = 0;
 	size_t accumulate = 0;
 	double divisor = 1;
@@ -244,7 +269,7 @@ double cosCompareD2D(void* vector1, void* vector2){
 double cosCompareS2S(void* vector1, void* vector2){
 	sparseRIV* comparator = (sparseRIV*)vector2;
 	denseRIV baseRIV = {0};
-	addS2D(baseRIV.values, (sparseRIV*)vector1);
+	addS2D(&baseRIV, (sparseRIV*)vector1);
 	baseRIV.magnitude = ((sparseRIV*)vector2)->magnitude;
 	long long int dot = 0;
 	int* locations_stop = comparator->locations+comparator->count;
@@ -279,4 +304,23 @@ void addS2I(int* destination, sparseRIV* input){
 	
 }
 
+size_t scaleValues(const int* values, const int* locations, size_t count, double multiplier, int single, int* valuesOut, int* locationsOut){
+	size_t kept = 0;
+	for(size_t i=0; i<count; i++){
+		/* if this point is 0, skip it */
+		if(!values[i]) continue;
+		
+		/* both are read before either is written, for scaling in place */
+		int location = locations? locations[i]: (int)i;
+		int value = single? round((float)values[i]*(float)multiplier): round(values[i]*multiplier);
+		
+		/* drop any 0 values */
+		if(!value) continue;
+		valuesOut[kept] = value;
+		locationsOut[kept] = location;
+		kept++;
+	}
+	return kept;
+}
+
 #endif /*RIVMATH_H*/
@@ -0,0 +1,260 @@
+#ifndef RIVPOOL_H_
+#define RIVPOOL_H_
+
+#include "RIVlower.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+/* a pool of denseRIV buffers, so that the vectors a lexicon pulls and pushes
+ * by the thousand are carved once from large mappings and then recycled,
+ * rather than each being allocated (and, being so large, mapped fresh and
+ * faulted in page by page) and freed again.
+ *
+ * buffers are carved from slabs, each holding as many as all the slabs before
+ * it, so that a pool grows to whatever a program keeps alive at once.  a
+ * buffer given back is "clean" if it is known to be all zeros, and "dirty" if
+ * not.  a clean one is ready to be taken for a new vector, and a dirty one is
+ * only zeroed when taken for something which needs it: a vector read dense
+ * is read over the whole of its values, and needs no zeroing at all.  a
+ * buffer given back along with the places of its non-zeros (as a vector just
+ * written sparse has them) is made clean at once, by zeroing those places
+ * alone.  fresh slabs are zero already, and are never touched before use
+ */
+
+/* POOLHUGEPAGES selects the pages slabs are mapped in: 0 for ordinary pages,
+ * 1 for transparent huge pages, where the kernel allows them, and 2 for
+ * explicit huge pages (reserved in /proc/sys/vm/nr_hugepages), falling back
+ * on transparent ones when none are free */
+#ifndef POOLHUGEPAGES
+#define POOLHUGEPAGES 1
+#endif
+
+/* POOLSLABMIN is the fewest buffers carved in one slab */
+#ifndef POOLSLABMIN
+#define POOLSLABMIN 8
+#endif
+
+/* the size of a huge page, to which slabs are rounded */
+#define POOLHUGESIZE (2UL<<20)
+
+/* each buffer is aligned to a cache line */
+#define POOLSTRIDE ((sizeof(denseRIV)+63)&~(size_t)63)
+
+struct poolSlab{
+	char* memory;
+	size_t length;
+	size_t capacity;
+	/* the buffers carved from it so far */
+	size_t carved;
+};
+
+typedef struct densePool{
+	struct poolSlab* slabs;
+	int slabCount;
+	/* buffers given back, all zeros or not */
+	denseRIV** clean;
+	size_t cleanCount;
+	denseRIV** dirty;
+	size_t dirtyCount;
+	/* every buffer carved, which is as many as either list may need to hold */
+	size_t bufferCount;
+	/* how many slabs lie in explicit huge pages */
+	int hugeSlabs;
+	pthread_mutex_t lock;
+}densePool;
+
+densePool* densePoolOpen();
+
+/* takes a buffer from the pool.  if "zeroed" is set, it is all zeros, as
+ * from calloc.  if not, only the fields before its frequency are zeros, and
+ * the caller must fill in everything from the frequency on.
+ * returns NULL if no memory can be had */
+denseRIV* densePoolTake(densePool* pool, int zeroed);
+
+/* gives a buffer taken from the pool back to it.  "locations", if not NULL,
+ * holds the "count" places where the vector's values may not be 0 */
+void densePoolGive(densePool* pool, denseRIV* vector, int* locations, size_t count);
+
+/* whether "vector" is a buffer of this pool */
+int densePoolOwns(densePool* pool, denseRIV* vector);
+
+/* unmaps every slab. buffers still taken are lost with them */
+void densePoolClose(densePool* pool);
+
+/* a vector's buffer, from "pool", or from calloc if there is no pool. the
+ * same as densePoolTake otherwise */
+denseRIV* densePoolAllocate(densePool* pool, int zeroed);
+
+/* gives a vector back to "pool" if it came from there, and frees it if not
+ * (as vectors made by the user and pushed are), so that a pooled vector and
+ * an allocated one can be let go of alike */
+void densePoolRelease(densePool* pool, denseRIV* vector, int* locations, size_t count);
+
+/* once set, nothing is given back or freed, as the process is dying and the
+ * pool's lock may be held by the thread that crashed */
+int densePoolHalted = 0;
+
+/* maps a new slab of at least "capacity" buffers. returns 0 on success */
+int densePoolGrow(densePool* pool, size_t capacity);
+
+
+/* begin definitions */
+
+densePool* densePoolOpen(){
+	densePool* pool = calloc(1, sizeof(densePool));
+	pthread_mutex_init(&pool->lock, NULL);
+	return pool;
+}
+
+int densePoolGrow(densePool* pool, size_t capacity){
+	size_t length = capacity*POOLSTRIDE;
+	char* memory = MAP_FAILED;
+	#if POOLHUGEPAGES > 0
+	length = (length+POOLHUGESIZE-1)&~(POOLHUGESIZE-1);
+	#endif /* POOLHUGEPAGES > 0 */
+	#if POOLHUGEPAGES > 1 && defined(MAP_HUGETLB)
+	memory = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if(memory != MAP_FAILED){
+		pool->hugeSlabs++;
+	}
+	#endif /* POOLHUGEPAGES > 1 */
+	if(memory == MAP_FAILED){
+		memory = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(memory == MAP_FAILED){
+			return 1;
+		}
+		#if POOLHUGEPAGES > 0 && defined(MADV_HUGEPAGE)
+		/* only advice: the kernel may decline it */
+		madvise(memory, length, MADV_HUGEPAGE);
+		#endif /* POOLHUGEPAGES > 0 */
+	}
+	/* rounding up may have made room for more */
+	capacity = length/POOLSTRIDE;
+
+	/* either list may come to hold every buffer */
+	denseRIV** clean = realloc(pool->clean, (pool->bufferCount+capacity)*sizeof(denseRIV*));
+	if(clean) pool->clean = clean;
+	denseRIV** dirty = realloc(pool->dirty, (pool->bufferCount+capacity)*sizeof(denseRIV*));
+	if(dirty) pool->dirty = dirty;
+	struct poolSlab* slabs = realloc(pool->slabs, (pool->slabCount+1)*sizeof(struct poolSlab));
+	if(slabs) pool->slabs = slabs;
+	if(!clean || !dirty || !slabs){
+		munmap(memory, length);
+		return 1;
+	}
+	struct poolSlab* slab = pool->slabs+pool->slabCount++;
+	slab->memory = memory;
+	slab->length = length;
+	slab->capacity = capacity;
+	slab->carved = 0;
+	return 0;
+}
+
+denseRIV* densePoolTake(densePool* pool, int zeroed){
+	denseRIV* output = NULL;
+	/* how much of the buffer must be cleared once out of the lock */
+	int clear = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	/* a caller which will fill the values itself is given a dirty buffer
+	 * first, which would otherwise cost a zeroing */
+	if(!zeroed && pool->dirtyCount){
+		output = pool->dirty[--pool->dirtyCount];
+		clear = 1;
+	}else if(pool->cleanCount){
+		output = pool->clean[--pool->cleanCount];
+	}else if(pool->dirtyCount){
+		output = pool->dirty[--pool->dirtyCount];
+		clear = 2;
+	}else{
+		struct poolSlab* slab = pool->slabCount? pool->slabs+pool->slabCount-1: NULL;
+		if(!slab || slab->carved == slab->capacity){
+			size_t capacity = pool->bufferCount > POOLSLABMIN? pool->bufferCount: POOLSLABMIN;
+			slab = densePoolGrow(pool, capacity)? NULL: pool->slabs+pool->slabCount-1;
+		}
+		if(slab){
+			output = (denseRIV*)(slab->memory+slab->carved++*POOLSTRIDE);
+			pool->bufferCount++;
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	if(clear == 1){
+		memset(output, 0, offsetof(denseRIV, frequency));
+	}else if(clear == 2){
+		memset(output, 0, sizeof(denseRIV));
+	}
+	return output;
+}
+
+void densePoolGive(densePool* pool, denseRIV* vector, int* locations, size_t count){
+	int clean = 0;
+	if(locations){
+		for(size_t i=0; i<count; i++){
+			vector->values[locations[i]] = 0;
+		}
+		clean = 1;
+	}else if(vector->tracked && !vector->nonZeros){
+		clean = 1;
+	}
+	if(clean){
+		/* and the name and metadata with them */
+		memset(vector, 0, offsetof(denseRIV, values));
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if(clean){
+		pool->clean[pool->cleanCount++] = vector;
+	}else{
+		pool->dirty[pool->dirtyCount++] = vector;
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int densePoolOwns(densePool* pool, denseRIV* vector){
+	char* address = (char*)vector;
+	int owned = 0;
+	pthread_mutex_lock(&pool->lock);
+	/* slabs grow geometrically, so there are few to search */
+	for(int i=0; !owned && i<pool->slabCount; i++){
+		owned = address >= pool->slabs[i].memory && address < pool->slabs[i].memory+pool->slabs[i].length;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return owned;
+}
+
+denseRIV* densePoolAllocate(densePool* pool, int zeroed){
+	if(pool){
+		return densePoolTake(pool, zeroed);
+	}
+	return calloc(1, sizeof(denseRIV));
+}
+
+void densePoolRelease(densePool* pool, denseRIV* vector, int* locations, size_t count){
+	if(densePoolHalted){
+		return;
+	}
+	if(pool && densePoolOwns(pool, vector)){
+		densePoolGive(pool, vector, locations, count);
+	}else{
+		free(vector);
+	}
+}
+
+void densePoolClose(densePool* pool){
+	for(int i=0; i<pool->slabCount; i++){
+		munmap(pool->slabs[i].memory, pool->slabs[i].length);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->slabs);
+	free(pool->clean);
+	free(pool->dirty);
+	free(pool);
+}
+
+#endif /* RIVPOOL_H_ */
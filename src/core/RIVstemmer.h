@@ -0,0 +1,280 @@
+#ifndef RIVSTEMMER_H_
+#define RIVSTEMMER_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the stem tree only knows the words of wordnet. this is a rule based
+ * stemmer (Porter's algorithm, which is what the stem tree's own stems
+ * were made with) for every other word, so that unknown words are stemmed
+ * rather than lost.  its results are remembered in a small cache, as the
+ * words a corpus lacks from wordnet (names, misspellings, jargon) tend to
+ * recur
+ */
+
+/* STEMFALLBACK 0 disables the fallback: words missing from the stem tree
+ * are dropped, as they were before.  it is only ever used with a complete
+ * stem tree: one built from a selection of stems still drops every word
+ * outside the selection, which the fallback would otherwise stem */
+#ifndef STEMFALLBACK
+#define STEMFALLBACK 1
+#endif
+
+/* STEMCACHESIZE is the number of remembered stems, a power of two.
+ * the cache belongs to one thread, so that it needs no locking */
+#ifndef STEMCACHESIZE
+#define STEMCACHESIZE 4096
+#endif
+
+/* words this long or longer are stemmed every time, rather than cached */
+#define STEMCACHEWORD 32
+
+struct stemCacheEntry{
+	char word[STEMCACHEWORD];
+	char stem[STEMCACHEWORD];
+};
+
+/* this thread's cache, allocated on first use */
+__thread struct stemCacheEntry* stemCache;
+
+/* stems a lowercase word of "length" letters in place, by Porter's
+ * algorithm. returns the length of the stem */
+size_t porterStem(char* word, size_t length);
+
+/* stems a lowercase, null terminated word in place, through the cache.
+ * returns word */
+char* fallbackStem(char* word, size_t length);
+
+/* frees this thread's cache, for threads which are about to exit */
+void stemCacheFree();
+
+
+/* begin definitions */
+
+/* the state of one word being stemmed: the word, the index of its last
+ * letter (k), and the end of the stem a suffix was matched after (j) */
+struct porterWord{
+	char* b;
+	int k;
+	int j;
+};
+
+/* whether b[i] is a consonant. y is a consonant after a vowel, or first */
+static int porterConsonant(struct porterWord* z, int i){
+	switch(z->b[i]){
+		case 'a': case 'e': case 'i': case 'o': case 'u': return 0;
+		case 'y': return i == 0? 1: !porterConsonant(z, i-1);
+		default: return 1;
+	}
+}
+
+/* the number of vowel-consonant sequences in b[0..j] */
+static int porterMeasure(struct porterWord* z){
+	int n = 0;
+	int i = 0;
+	while(1){
+		if(i > z->j) return n;
+		if(!porterConsonant(z, i)) break;
+		i++;
+	}
+	i++;
+	while(1){
+		while(1){
+			if(i > z->j) return n;
+			if(porterConsonant(z, i)) break;
+			i++;
+		}
+		i++;
+		n++;
+		while(1){
+			if(i > z->j) return n;
+			if(!porterConsonant(z, i)) break;
+			i++;
+		}
+		i++;
+	}
+}
+
+/* whether b[0..j] contains a vowel */
+static int porterVowelInStem(struct porterWord* z){
+	for(int i=0; i<=z->j; i++){
+		if(!porterConsonant(z, i)) return 1;
+	}
+	return 0;
+}
+
+/* whether b[i-1..i] is a double consonant */
+static int porterDouble(struct porterWord* z, int i){
+	if(i < 1 || z->b[i] != z->b[i-1]) return 0;
+	return porterConsonant(z, i);
+}
+
+/* whether b[i-2..i] is consonant-vowel-consonant, the last not w, x or y */
+static int porterCVC(struct porterWord* z, int i){
+	if(i < 2 || !porterConsonant(z, i) || porterConsonant(z, i-1) || !porterConsonant(z, i-2)){
+		return 0;
+	}
+	char ch = z->b[i];
+	return ch != 'w' && ch != 'x' && ch != 'y';
+}
+
+/* whether b[0..k] ends with "suffix", setting j to just before it if so */
+static int porterEnds(struct porterWord* z, const char* suffix){
+	int length = strlen(suffix);
+	if(length > z->k+1 || suffix[length-1] != z->b[z->k]) return 0;
+	if(memcmp(z->b+z->k-length+1, suffix, length)) return 0;
+	z->j = z->k-length;
+	return 1;
+}
+
+/* replaces b[j+1..k] with "replacement" */
+static void porterSet(struct porterWord* z, const char* replacement){
+	int length = strlen(replacement);
+	memmove(z->b+z->j+1, replacement, length);
+	z->k = z->j+length;
+}
+
+/* porterSet, if the stem before the suffix has a measure above 0 */
+static void porterReplace(struct porterWord* z, const char* replacement){
+	if(porterMeasure(z) > 0) porterSet(z, replacement);
+}
+
+/* plurals, -ed and -ing */
+static void porterStep1ab(struct porterWord* z){
+	if(z->b[z->k] == 's'){
+		if(porterEnds(z, "sses")) z->k -= 2;
+		else if(porterEnds(z, "ies")) porterSet(z, "i");
+		else if(z->b[z->k-1] != 's') z->k--;
+	}
+	if(porterEnds(z, "eed")){
+		if(porterMeasure(z) > 0) z->k--;
+	}else if((porterEnds(z, "ed") || porterEnds(z, "ing")) && porterVowelInStem(z)){
+		z->k = z->j;
+		if(porterEnds(z, "at")) porterSet(z, "ate");
+		else if(porterEnds(z, "bl")) porterSet(z, "ble");
+		else if(porterEnds(z, "iz")) porterSet(z, "ize");
+		else if(porterDouble(z, z->k)){
+			z->k--;
+			char ch = z->b[z->k];
+			if(ch == 'l' || ch == 's' || ch == 'z') z->k++;
+		}else if(porterMeasure(z) == 1 && porterCVC(z, z->k)){
+			porterSet(z, "e");
+		}
+	}
+}
+
+/* terminal y to i, when there is another vowel in the stem */
+static void porterStep1c(struct porterWord* z){
+	if(porterEnds(z, "y") && porterVowelInStem(z)) z->b[z->k] = 'i';
+}
+
+/* double suffixes to single ones, -ization to -ize and so on */
+static void porterStep2(struct porterWord* z){
+	static const char* rules[][2] = {
+		{"ational", "ate"}, {"tional", "tion"}, {"enci", "ence"}, {"anci", "ance"},
+		{"izer", "ize"}, {"bli", "ble"}, {"alli", "al"}, {"entli", "ent"},
+		{"eli", "e"}, {"ousli", "ous"}, {"ization", "ize"}, {"ation", "ate"},
+		{"ator", "ate"}, {"alism", "al"}, {"iveness", "ive"}, {"fulness", "ful"},
+		{"ousness", "ous"}, {"aliti", "al"}, {"iviti", "ive"}, {"biliti", "ble"},
+		{"logi", "log"}
+	};
+	/* the first rule whose suffix matches is the only one tried */
+	for(size_t i=0; i<sizeof(rules)/sizeof(*rules); i++){
+		if(porterEnds(z, rules[i][0])){
+			porterReplace(z, rules[i][1]);
+			return;
+		}
+	}
+}
+
+/* -ic-, -full, -ness and the like */
+static void porterStep3(struct porterWord* z){
+	static const char* rules[][2] = {
+		{"icate", "ic"}, {"ative", ""}, {"alize", "al"}, {"iciti", "ic"},
+		{"ical", "ic"}, {"ful", ""}, {"ness", ""}
+	};
+	for(size_t i=0; i<sizeof(rules)/sizeof(*rules); i++){
+		if(porterEnds(z, rules[i][0])){
+			porterReplace(z, rules[i][1]);
+			return;
+		}
+	}
+}
+
+/* -ant, -ence and the like, from stems of measure above 1 */
+static void porterStep4(struct porterWord* z){
+	static const char* suffixes[] = {
+		"al", "ance", "ence", "er", "ic", "able", "ible", "ant", "ement",
+		"ment", "ent", "ion", "ou", "ism", "ate", "iti", "ous", "ive", "ize"
+	};
+	size_t i;
+	for(i=0; i<sizeof(suffixes)/sizeof(*suffixes); i++){
+		if(porterEnds(z, suffixes[i])){
+			/* -ion only after s or t */
+			if(!strcmp(suffixes[i], "ion") && (z->j < 0 || (z->b[z->j] != 's' && z->b[z->j] != 't'))){
+				continue;
+			}
+			break;
+		}
+	}
+	if(i == sizeof(suffixes)/sizeof(*suffixes)) return;
+	if(porterMeasure(z) > 1) z->k = z->j;
+}
+
+/* a final -e, and -ll to -l, from long enough stems */
+static void porterStep5(struct porterWord* z){
+	z->j = z->k;
+	if(z->b[z->k] == 'e'){
+		int measure = porterMeasure(z);
+		if(measure > 1 || (measure == 1 && !porterCVC(z, z->k-1))) z->k--;
+	}
+	if(z->b[z->k] == 'l' && porterDouble(z, z->k) && porterMeasure(z) > 1) z->k--;
+}
+
+size_t porterStem(char* word, size_t length){
+	/* words of one or two letters are left as they are */
+	if(length <= 2) return length;
+	struct porterWord z = {word, length-1, 0};
+	porterStep1ab(&z);
+	if(z.k > 0){
+		porterStep1c(&z);
+		porterStep2(&z);
+		porterStep3(&z);
+		porterStep4(&z);
+		porterStep5(&z);
+	}
+	return z.k+1;
+}
+
+char* fallbackStem(char* word, size_t length){
+	if(length >= STEMCACHEWORD){
+		word[porterStem(word, length)] = 0;
+		return word;
+	}
+	if(!stemCache){
+		stemCache = calloc(STEMCACHESIZE, sizeof(struct stemCacheEntry));
+	}
+	/* each word has one place in the cache, shared by others with the same
+	 * hash, so that the cache can never grow past its size */
+	unsigned int hash = 2166136261u;
+	for(size_t i=0; i<length; i++){
+		hash ^= (unsigned char)word[i];
+		hash *= 16777619u;
+	}
+	struct stemCacheEntry* entry = stemCache+((hash^(hash>>16))&(STEMCACHESIZE-1));
+	if(!strcmp(entry->word, word)){
+		strcpy(word, entry->stem);
+		return word;
+	}
+	memcpy(entry->word, word, length+1);
+	word[porterStem(word, length)] = 0;
+	strcpy(entry->stem, word);
+	return word;
+}
+
+void stemCacheFree(){
+	free(stemCache);
+	stemCache = NULL;
+}
+
+#endif /* RIVSTEMMER_H_ */
@@ -0,0 +1,139 @@
+#ifndef RIVTOKENIZER_H_
+#define RIVTOKENIZER_H_
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* the tokenizer walks a block of text, yielding each whitespace-delimited
+ * word as a span (a pointer into the text, and a length) rather than
+ * copying it out.  it accepts any amount and any kind of whitespace between
+ * words, exactly as scanf's "%s" would, and never reads past "end", so the
+ * text need not be null terminated
+ */
+typedef struct RIVtokenizer{
+	const char* cursor;
+	const char* end;
+}RIVtokenizer;
+
+/* TOKENSIZE is the size of the buffers words are copied or cleaned into,
+ * the same as the name of a RIV.  longer words are truncated */
+#define TOKENSIZE 100
+
+/* prepares a tokenizer to walk "length" characters of text */
+void tokenizerInit(RIVtokenizer* tokens, const char* text, size_t length);
+
+/* finds the next word, pointing "word" at its first character and
+ * returning its length.  returns 0 when the text is exhausted */
+size_t nextToken(RIVtokenizer* tokens, const char** word);
+
+/* fused clean and lowercase: copies only the letters of a word, lowercased,
+ * into "output" (at least TOKENSIZE chars), null terminated.
+ * returns the length of the cleaned word, 0 if nothing was left */
+size_t cleanToken(const char* word, size_t length, char* output);
+
+/* copies a word into "output" (at least TOKENSIZE chars), null terminated */
+size_t copyToken(const char* word, size_t length, char* output);
+
+
+/* begin definitions */
+
+/* true for the characters that isspace() accepts in the C locale */
+#define ISTOKENSPACE(c) ((c) == ' ' || (unsigned char)((c) - '\t') < 5)
+
+#ifdef __SSE2__
+/* returns a 16 bit mask, one bit set for each whitespace byte of the block */
+static inline int spaceMask16(const char* block){
+	__m128i chunk = _mm_loadu_si128((const __m128i*)block);
+	__m128i spaces = _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '));
+	/* '\t' through '\r' are contiguous: subtract '\t' and test <= 4 unsigned */
+	__m128i shifted = _mm_sub_epi8(chunk, _mm_set1_epi8('\t'));
+	__m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(4)), shifted);
+	return _mm_movemask_epi8(_mm_or_si128(spaces, controls));
+}
+#endif /* __SSE2__ */
+
+void tokenizerInit(RIVtokenizer* tokens, const char* text, size_t length){
+	tokens->cursor = text;
+	tokens->end = text+length;
+}
+
+size_t nextToken(RIVtokenizer* tokens, const char** word){
+	const char* cursor = tokens->cursor;
+	const char* end = tokens->end;
+
+	/* skip leading whitespace */
+	#ifdef __SSE2__
+	while(cursor+16 <= end){
+		int mask = spaceMask16(cursor);
+		if(mask != 0xFFFF){
+			/* the first zero bit is the first character of the word */
+			cursor += __builtin_ctz(~mask);
+			goto wordFound;
+		}
+		cursor += 16;
+	}
+	#endif /* __SSE2__ */
+	while(cursor<end && ISTOKENSPACE(*cursor)){
+		cursor++;
+	}
+	if(cursor == end){
+		tokens->cursor = end;
+		return 0;
+	}
+	#ifdef __SSE2__
+	wordFound:
+	#endif /* __SSE2__ */
+	*word = cursor;
+
+	/* find the whitespace that ends this word */
+	#ifdef __SSE2__
+	while(cursor+16 <= end){
+		int mask = spaceMask16(cursor);
+		if(mask){
+			cursor += __builtin_ctz(mask);
+			goto wordEnded;
+		}
+		cursor += 16;
+	}
+	#endif /* __SSE2__ */
+	while(cursor<end && !ISTOKENSPACE(*cursor)){
+		cursor++;
+	}
+	#ifdef __SSE2__
+	wordEnded:
+	#endif /* __SSE2__ */
+	tokens->cursor = cursor;
+	return cursor-*word;
+}
+
+size_t cleanToken(const char* word, size_t length, char* output){
+	char* outLetter = output;
+	char* outStop = output+TOKENSIZE-1;
+	const char* wordStop = word+length;
+
+	while(word<wordStop && outLetter<outStop){
+		/* folding case first lets one range test accept both cases */
+		char lower = *word | 0x20;
+		if(lower >= 'a' && lower <= 'z'){
+			*(outLetter++) = lower;
+		}
+		word++;
+	}
+	*outLetter = 0;
+	return outLetter-output;
+}
+
+size_t copyToken(const char* word, size_t length, char* output){
+	if(length > TOKENSIZE-1){
+		length = TOKENSIZE-1;
+	}
+	memcpy(output, word, length);
+	output[length] = 0;
+	return length;
+}
+
+#endif /* RIVTOKENIZER_H_ */
@@ -0,0 +1,164 @@
+#ifndef RIVTRACE_H_
+#define RIVTRACE_H_
+
+/* tracing records spans, named intervals of time, around the stages of a
+ * program, so that it can be seen where its time goes. spans are kept in
+ * a ring buffer belonging to each thread, so recording one costs two clock
+ * reads and no locking, and a long run keeps only its latest spans.
+ * traceWrite exports them in the Chrome trace format, which chrome://tracing
+ * and Perfetto (ui.perfetto.dev) display as a timeline.
+ *
+ * RIVTRACE macro enables tracing. left at 0, the trace macros compile to
+ * nothing, and tracing costs nothing at all
+ */
+#ifndef RIVTRACE
+#define RIVTRACE 0
+#endif
+
+/* TRACEBUFFER is the number of spans each thread keeps, a power of two */
+#ifndef TRACEBUFFER
+#define TRACEBUFFER (1<<16)
+#endif
+
+#if RIVTRACE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+/* a span's name must be a string literal (or otherwise outlive the trace) */
+struct traceEvent{
+	const char* name;
+	uint64_t start;
+	uint64_t duration;
+};
+
+/* one thread's spans.  rings are never freed, so that the spans of threads
+ * which have exited can still be exported */
+struct traceRing{
+	struct traceEvent events[TRACEBUFFER];
+	/* the number of spans ever recorded, of which the last TRACEBUFFER are kept */
+	uint64_t recorded;
+	int tid;
+	/* sampling state: how deep the current span is nested, whether the
+	 * outermost span was chosen to be recorded, and how many have been seen */
+	int depth;
+	int sampled;
+	uint64_t outermost;
+	struct traceRing* next;
+};
+
+/* a span in progress */
+struct traceSpan{
+	const char* name;
+	uint64_t start;
+};
+
+/* every thread's ring, newest first */
+struct traceRing* traceRings = NULL;
+__thread struct traceRing* traceLocal = NULL;
+
+/* in sampling mode, only one in every traceSampling outermost spans is
+ * recorded, along with every span nested inside it, so that tracing can
+ * be left on in long production runs.  1 records everything. it is read
+ * from the environment variable RIVTRACESAMPLE when a thread first traces */
+int traceSampling = 0;
+
+/* marks the start and end of a span. "span" names a variable to hold it */
+#define TRACESTART(span, spanName) struct traceSpan span = traceBegin(spanName)
+#define TRACESTOP(span) traceEnd(&span)
+
+struct traceSpan traceBegin(const char* name);
+void traceEnd(struct traceSpan* span);
+
+/* writes every thread's spans to fileName as a Chrome trace.
+ * returns 0 on success. spans still being recorded may be torn, so
+ * this is best called once other threads are done */
+int traceWrite(const char* fileName);
+
+/* the calling thread's ring, created on first use */
+struct traceRing* traceThread();
+
+/* a monotonic clock, in nanoseconds */
+uint64_t traceClock();
+
+
+/* begin definitions */
+
+uint64_t traceClock(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1000000000ULL+now.tv_nsec;
+}
+
+struct traceRing* traceThread(){
+	if(traceLocal) return traceLocal;
+	if(!traceSampling){
+		char* sampling = getenv("RIVTRACESAMPLE");
+		int rate = sampling? atoi(sampling): 1;
+		traceSampling = rate > 0? rate: 1;
+	}
+	traceLocal = calloc(1, sizeof(struct traceRing));
+	traceLocal->tid = syscall(SYS_gettid);
+	/* rings are only ever added, at the head, so no lock is needed */
+	traceLocal->next = __atomic_load_n(&traceRings, __ATOMIC_ACQUIRE);
+	while(!__atomic_compare_exchange_n(&traceRings, &traceLocal->next, traceLocal,
+			1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+	return traceLocal;
+}
+
+struct traceSpan traceBegin(const char* name){
+	struct traceRing* ring = traceThread();
+	if(!ring->depth++){
+		ring->sampled = !(ring->outermost++ % traceSampling);
+	}
+	struct traceSpan span = {name, ring->sampled? traceClock(): 0};
+	return span;
+}
+
+void traceEnd(struct traceSpan* span){
+	struct traceRing* ring = traceLocal;
+	ring->depth--;
+	if(!ring->sampled) return;
+	struct traceEvent* event = ring->events+(ring->recorded&(TRACEBUFFER-1));
+	event->name = span->name;
+	event->start = span->start;
+	event->duration = traceClock()-span->start;
+	/* published after the event, for traceWrite in another thread */
+	__atomic_store_n(&ring->recorded, ring->recorded+1, __ATOMIC_RELEASE);
+}
+
+int traceWrite(const char* fileName){
+	FILE* output = fopen(fileName, "w");
+	if(!output) return 1;
+	int pid = getpid();
+	int first = 1;
+	fputs("{\"displayTimeUnit\": \"ns\", \"traceEvents\": [", output);
+	for(struct traceRing* ring = __atomic_load_n(&traceRings, __ATOMIC_ACQUIRE); ring; ring = ring->next){
+		uint64_t recorded = __atomic_load_n(&ring->recorded, __ATOMIC_ACQUIRE);
+		uint64_t oldest = recorded > TRACEBUFFER? recorded-TRACEBUFFER: 0;
+		fprintf(output, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"thread %d\"}}",
+			first? "": ",", pid, ring->tid, ring->tid);
+		first = 0;
+		for(uint64_t i=oldest; i<recorded; i++){
+			struct traceEvent* event = ring->events+(i&(TRACEBUFFER-1));
+			/* complete ("X") events, timed in microseconds */
+			fprintf(output, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+				event->name, pid, ring->tid, event->start/1000.0, event->duration/1000.0);
+		}
+	}
+	fputs("\n]}\n", output);
+	return fclose(output) != 0;
+}
+
+#else /* RIVTRACE */
+
+#define TRACESTART(span, spanName) ((void)0)
+#define TRACESTOP(span) ((void)0)
+
+#endif /* RIVTRACE */
+
+#endif /* RIVTRACE_H_ */
@@ -0,0 +1,402 @@
+#ifndef RIVVECTORIZE_H_
+#define RIVVECTORIZE_H_
+
+#include "RIVlower.h"
+#include "RIVmath.h"
+#include "RIVlexicon.h"
+#include "RIVlexMerge.h"
+#include "RIVinput.h"
+#include "RIVcollection.h"
+
+#include <pthread.h>
+
+/* vectorizing a document turns it into the sum of the lexicon vectors of
+ * its words (an L3 vector, as line2L3 makes for a single line).  done for
+ * many documents at once, the lexicon is loaded whole, read only, into a
+ * lexView, which any number of threads may share without locking, and the
+ * documents are vectorized in batches across all processors, each batch
+ * being read and the last written while the current one is worked on
+ */
+
+/* VECTORBATCH is the number of documents vectorized together */
+#ifndef VECTORBATCH
+#define VECTORBATCH 4096
+#endif
+
+/* every vector of a lexicon, in sparse form, found by word */
+typedef struct lexView{
+	RIVtree* index;
+	sparseRIV** vectors;
+	int count;
+	/* words whose vectors could not be read, and were left out */
+	int failures;
+}lexView;
+
+/* loads every word of the lexicon lexName, with threadCount threads
+ * (0 for one per processor). returns NULL if the lexicon does not exist,
+ * or was built with settings other than this program's */
+lexView* lexViewOpen(const char* lexName, int threadCount);
+
+/* the vector of a word, or NULL if the lexicon does not hold it.  the vector
+ * belongs to the view, and must not be changed */
+sparseRIV* lexViewGet(lexView* view, char* word);
+
+void lexViewClose(lexView* view);
+
+/* sums the vectors of a list of words (as made by cleanToWords) into an L3
+ * vector, whose contextSize is the number of words the view held.
+ * "accumulate" is RIVSIZE integers of scratch, all 0s, and left that way,
+ * so that each thread may keep one for every document it vectorizes */
+sparseRIV* wordsToL3(lexView* view, char** words, int wordCount, int* accumulate);
+
+/* vectorizes every line of input as a document, with threadCount threads
+ * (0 for one per processor), appending each vector to the collection output
+ * in order (see RIVcollection.h), which the caller finishes.  a document is
+ * named by its line number, from 1, or if "named" is set and the line
+ * begins with a name and a tab, by that name.  returns the number of
+ * documents, or -1 if the output could not be written */
+long vectorizeStream(lexView* view, RIVtree* stemRoot, RIVinput* input, RIVcollectionWriter* output, int threadCount, int named);
+
+/* names one line of a stream as vectorizeStream does: if "named" is set and
+ * the line begins with a name and a tab, the name (if it fits the 100
+ * characters of "name") is copied there, and *text moved past the tab.
+ * otherwise the line is named "number".  returns the length of the text */
+size_t documentName(const char** text, size_t length, int named, long number, char* name);
+
+/* shared by the threads loading one lexView */
+struct viewJob{
+	const char* lexName;
+	char** words;
+	int wordCount;
+	sparseRIV** vectors;
+	/* the next word to be claimed by a thread */
+	int cursor;
+	int failures;
+	pthread_mutex_t lock;
+};
+
+/* the body of each loading thread */
+void* viewThread(void* jobV);
+
+/* a batch of documents: their text, one after another, and each one's
+ * place in it, and once vectorized, their vectors */
+struct vectorBatch{
+	RIVbuffer text;
+	size_t starts[VECTORBATCH];
+	size_t lengths[VECTORBATCH];
+	sparseRIV* vectors[VECTORBATCH];
+	int count;
+	/* the line number of the first document */
+	long first;
+};
+
+/* shared by the threads of one vectorizeStream call.  the threads wait
+ * between batches, and each new batch is announced by a new generation */
+struct vectorJob{
+	lexView* view;
+	RIVtree* stemRoot;
+	int named;
+	struct vectorBatch* batch;
+	int cursor;
+	int busy;
+	int generation;
+	int closing;
+	pthread_mutex_t lock;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+};
+
+/* the body of each vectorizing thread */
+void* vectorThread(void* jobV);
+
+/* reads up to VECTORBATCH lines into a batch, returning how many */
+int vectorBatchRead(RIVinput* input, struct vectorBatch* batch, long first);
+
+/* vectorizes one document of the batch */
+sparseRIV* vectorBatchDocument(struct vectorJob* job, int index, int* accumulate, RIVbuffer* buffer, RIVwords* words);
+
+/* begin definitions */
+
+lexView* lexViewOpen(const char* lexName, int threadCount){
+	struct stat st = {0};
+	if(stat(lexName, &st) == -1) return NULL;
+	if(lexHeaderCheck(lexName, 0)) return NULL;
+	if(threadCount < 1){
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+		if(threadCount < 1) threadCount = 1;
+	}
+	struct viewJob job = {0};
+	job.lexName = lexName;
+	job.words = mergeWordList((char**)&lexName, 1, &job.wordCount);
+	job.vectors = calloc(job.wordCount+1, sizeof(sparseRIV*));
+	pthread_mutex_init(&job.lock, NULL);
+
+	pthread_t* threads = malloc(threadCount*sizeof(pthread_t));
+	for(int i=0; i<threadCount; i++){
+		pthread_create(&threads[i], NULL, viewThread, &job);
+	}
+	for(int i=0; i<threadCount; i++){
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&job.lock);
+
+	lexView* view = calloc(1, sizeof(lexView));
+	view->failures = job.failures;
+	view->vectors = job.vectors;
+	view->index = treeCreate(job.wordCount);
+	/* the vectors are packed down over those which failed, and found by the
+	 * names they hold, so that the index need copy no words */
+	for(int i=0; i<job.wordCount; i++){
+		if(job.vectors[i]){
+			view->vectors[view->count] = job.vectors[i];
+			treePlace(view->index, view->vectors[view->count]->name, view->vectors[view->count], 0);
+			view->count++;
+		}
+		free(job.words[i]);
+	}
+	free(job.words);
+	return view;
+}
+
+void* viewThread(void* jobV){
+	struct viewJob* job = (struct viewJob*)jobV;
+	/* each thread reads into its own vector and slot, and leaves the vector
+	 * cleared by each consolidation, ready for the next word */
+	denseRIV* accumulate = calloc(1, sizeof(denseRIV));
+	int* readSlot = malloc(2*RIVSIZE*sizeof(int));
+	char pathString[300];
+
+	while(1){
+		pthread_mutex_lock(&job->lock);
+		int index = job->cursor++;
+		pthread_mutex_unlock(&job->lock);
+		if(index >= job->wordCount) break;
+
+		char* word = job->words[index];
+		int failed = strlen(word) >= sizeof(accumulate->name);
+		if(!failed){
+			sprintf(pathString, "%s/%s", job->lexName, word);
+			FILE* lexWord = fopen(pathString, "rb");
+			failed = !lexWord || fLexAdd(lexWord, accumulate, readSlot);
+			if(lexWord) fclose(lexWord);
+		}
+		sparseRIV* vector = consolidateD2SClear(accumulate->values);
+		if(failed || !vector){
+			fprintf(stderr, "vector read failure: %s/%s\n", job->lexName, word);
+			free(vector);
+			accumulate->frequency = 0;
+			accumulate->contextSize = 0;
+			pthread_mutex_lock(&job->lock);
+			job->failures++;
+			pthread_mutex_unlock(&job->lock);
+			continue;
+		}
+		strcpy(vector->name, word);
+		vector->frequency = accumulate->frequency;
+		vector->contextSize = accumulate->contextSize;
+		vector->magnitude = getMagnitudeSparse(vector);
+		accumulate->frequency = 0;
+		accumulate->contextSize = 0;
+		/* each word has a place of its own, so this needs no lock */
+		job->vectors[index] = vector;
+	}
+	free(accumulate);
+	free(readSlot);
+	return NULL;
+}
+
+sparseRIV* lexViewGet(lexView* view, char* word){
+	return treeSearch(view->index, word);
+}
+
+void lexViewClose(lexView* view){
+	destroyTree(view->index);
+	for(int i=0; i<view->count; i++){
+		free(view->vectors[i]);
+	}
+	free(view->vectors);
+	free(view);
+}
+
+sparseRIV* wordsToL3(lexView* view, char** words, int wordCount, int* accumulate){
+	int found = 0;
+	for(int i=0; i<wordCount; i++){
+		sparseRIV* wordRIV = lexViewGet(view, words[i]);
+		if(!wordRIV) continue;
+
+		/* add this vector to the accumulating text vector */
+		addS2I(accumulate, wordRIV);
+		found++;
+	}
+	/* reduce the sum to a sparse form, clearing it for the next text */
+	sparseRIV* output = consolidateD2SClear(accumulate);
+	if(!output) return NULL;
+	*output->name = 0;
+	output->frequency = 0;
+	output->contextSize = found;
+	output->magnitude = getMagnitudeSparse(output);
+	return output;
+}
+
+long vectorizeStream(lexView* view, RIVtree* stemRoot, RIVinput* input, RIVcollectionWriter* output, int threadCount, int named){
+	if(threadCount < 1){
+		threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+		if(threadCount < 1) threadCount = 1;
+	}
+
+	struct vectorJob job = {0};
+	job.view = view;
+	job.stemRoot = stemRoot;
+	job.named = named;
+	pthread_mutex_init(&job.lock, NULL);
+	pthread_cond_init(&job.started, NULL);
+	pthread_cond_init(&job.finished, NULL);
+	pthread_t* threads = malloc(threadCount*sizeof(pthread_t));
+	for(int i=0; i<threadCount; i++){
+		pthread_create(&threads[i], NULL, vectorThread, &job);
+	}
+
+	/* one batch is vectorized while the one before it is written, and the
+	 * one after it read */
+	struct vectorBatch* batches = calloc(2, sizeof(struct vectorBatch));
+	struct vectorBatch* current = batches;
+	struct vectorBatch* previous = NULL;
+	long documents = vectorBatchRead(input, current, 1);
+	int failed = 0;
+	while(current->count){
+		pthread_mutex_lock(&job.lock);
+		job.batch = current;
+		job.cursor = 0;
+		job.busy = threadCount;
+		job.generation++;
+		pthread_cond_broadcast(&job.started);
+		pthread_mutex_unlock(&job.lock);
+
+		if(previous){
+			for(int i=0; i<previous->count; i++){
+				failed |= collectionAppend(output, previous->vectors[i]);
+				free(previous->vectors[i]);
+			}
+		}
+		struct vectorBatch* next = current == batches? batches+1: batches;
+		documents += vectorBatchRead(input, next, documents+1);
+
+		pthread_mutex_lock(&job.lock);
+		while(job.busy){
+			pthread_cond_wait(&job.finished, &job.lock);
+		}
+		pthread_mutex_unlock(&job.lock);
+		previous = current;
+		current = next;
+	}
+	if(previous){
+		for(int i=0; i<previous->count; i++){
+			failed |= collectionAppend(output, previous->vectors[i]);
+			free(previous->vectors[i]);
+		}
+	}
+
+	pthread_mutex_lock(&job.lock);
+	job.closing = 1;
+	pthread_cond_broadcast(&job.started);
+	pthread_mutex_unlock(&job.lock);
+	for(int i=0; i<threadCount; i++){
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	pthread_mutex_destroy(&job.lock);
+	pthread_cond_destroy(&job.started);
+	pthread_cond_destroy(&job.finished);
+	bufferFree(&batches[0].text);
+	bufferFree(&batches[1].text);
+	free(batches);
+
+	if(failed) return -1;
+	return documents;
+}
+
+int vectorBatchRead(RIVinput* input, struct vectorBatch* batch, long first){
+	const char* line;
+	size_t length;
+	batch->text.length = 0;
+	batch->count = 0;
+	batch->first = first;
+	/* lines are only valid until the next is read, so each is copied */
+	while(batch->count < VECTORBATCH && (length = inputNextLine(input, &line))){
+		bufferReserve(&batch->text, length);
+		memcpy(batch->text.text+batch->text.length, line, length);
+		batch->starts[batch->count] = batch->text.length;
+		batch->lengths[batch->count] = length;
+		batch->text.length += length;
+		batch->count++;
+	}
+	return batch->count;
+}
+
+void* vectorThread(void* jobV){
+	struct vectorJob* job = (struct vectorJob*)jobV;
+	/* each thread keeps its own scratch from batch to batch */
+	int* accumulate = calloc(RIVSIZE, sizeof(int));
+	RIVbuffer buffer = {0};
+	RIVwords words = {0};
+	int generation = 0;
+
+	while(1){
+		pthread_mutex_lock(&job->lock);
+		while(job->generation == generation && !job->closing){
+			pthread_cond_wait(&job->started, &job->lock);
+		}
+		if(job->closing){
+			pthread_mutex_unlock(&job->lock);
+			break;
+		}
+		generation = job->generation;
+		struct vectorBatch* batch = job->batch;
+		pthread_mutex_unlock(&job->lock);
+
+		int index;
+		while((index = __atomic_fetch_add(&job->cursor, 1, __ATOMIC_RELAXED)) < batch->count){
+			/* each document has a place of its own, so this needs no lock */
+			batch->vectors[index] = vectorBatchDocument(job, index, accumulate, &buffer, &words);
+		}
+
+		pthread_mutex_lock(&job->lock);
+		if(!--job->busy){
+			pthread_cond_signal(&job->finished);
+		}
+		pthread_mutex_unlock(&job->lock);
+	}
+	free(accumulate);
+	bufferFree(&buffer);
+	free(words.list);
+	stemCacheFree();
+	return NULL;
+}
+
+size_t documentName(const char** text, size_t length, int named, long number, char* name){
+	const char* tab = named? memchr(*text, '\t', length): NULL;
+	if(tab && tab-*text < 100){
+		memcpy(name, *text, tab-*text);
+		name[tab-*text] = 0;
+		length -= tab+1-*text;
+		*text = tab+1;
+	}else{
+		sprintf(name, "%ld", number);
+	}
+	return length;
+}
+sparseRIV* vectorBatchDocument(struct vectorJob* job, int index, int* accumulate, RIVbuffer* buffer, RIVwords* words){
+	struct vectorBatch* batch = job->batch;
+	const char* text = batch->text.text+batch->starts[index];
+	char name[100];
+	size_t length = documentName(&text, batch->lengths[index], job->named, batch->first+index, name);
+	cleanToWords(job->stemRoot, text, length, buffer, words);
+	sparseRIV* output = wordsToL3(job->view, words->list, words->count, accumulate);
+	if(output){
+		strcpy(output->name, name);
+	}
+	return output;
+}
+
+#endif /* RIVVECTORIZE_H_ */
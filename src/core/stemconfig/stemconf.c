@@ -1,51 +1,40 @@
 #include <stdio.h>
 #include "../RIVaccessories.h"
-int configInsert(RIVtree* node, char* letter, int treeSize);
 int stemTreeConfig();
-int main(){
+/* prints the number of distinct words in the wordnet file. given a file
+ * name, also writes the full stem tree there as a mappable stem table */
+int main(int argc, char* argv[]){
+	if(argc > 1){
+		/* built from the literals, as any table already mapped may be stale */
+		RIVtree* stems = stemTreeBuild(NULL);
+		if(stemTableWrite(stems, argv[1])){
+			fprintf(stderr, "failed to write stem table %s\n", argv[1]);
+			return 1;
+		}
+		destroyTree(stems);
+	}
 	int count = stemTreeConfig();
 	printf("%d", count);
 	
 }
 
-int configInsert(RIVtree* node, char* letter, int treeSize){
-	
-	node->downstream++;
-	if(*(letter)){
-		if(!node->links[*(letter)-'a']){
-			treeSize++;
-			node->links[*(letter)-'a'] = calloc(1, sizeof(RIVtree));
-			
-		}
-		return configInsert(node->links[*(letter)-'a'], letter+1, treeSize);
-	}else{
-		return treeSize;
-	}
-}
-
+/* counts the distinct words of the wordnet file, which is the number of
+ * entries a stem tree will be sized for */
 int stemTreeConfig(){
-	int treeSize = 1;
 	FILE* wordFile = fopen("wordset.txt", "r");
 	if(!wordFile){
 		printf("no wordnet file");
 		return 0;
 	}
 	
-	RIVtree* rootNode = calloc(1, sizeof(RIVtree));
+	RIVtree* rootNode = treeCreate(0);
+	int* dummyValue = (int*)1;
 	char word[100];
-	char* stem = (char*)stemset;
-	int displacement;
-	while(fscanf(wordFile, "%s", word)){
-		sscanf(stem, "%*s%n", &displacement);
-		stem[displacement] = '\0';
-		
-		
-		treeSize = configInsert(rootNode, word, treeSize);
-		if(feof(wordFile)){
-			break;
-		}
-		stem += displacement+1;
+	while(fscanf(wordFile, "%99s", word) == 1){
+		treeInsert(rootNode, word, dummyValue);
 	}
 	fclose(wordFile);
+	int treeSize = rootNode->count;
+	destroyTree(rootNode);
 	return treeSize;
 }
@@ -34,5 +34,9 @@ treesize = tempfile.read();
 finalOut = finalOut + treesize + ';'
 stemFile = open("stemset.h", "w")
 stemFile.write(finalOut)
-stemFile.close;
+stemFile.close();
+
+#the same tree, precompiled, for tools to map instead of building (see stemTreeSetup)
+call(["gcc", "stemconf.c","-o", "stemconfig"])
+call(["./stemconfig", "stemtable.bin"], stdout=open("tempfile.txt", "w"))
 